@@ -1,9 +1,14 @@
 #include "Analyse.h"
 
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <random>
 #include <stack>
+#include <thread>
+
+#include "DenseFact_declaration.h"
+#include "Ordering.h"
 
 Analyse::Analyse(const std::vector<int>& rows_input,
                  const std::vector<int>& ptr_input, FactType type_input,
@@ -52,18 +57,16 @@ Analyse::Analyse(const std::vector<int>& rows_input,
   ready = true;
 }
 
-void Analyse::GetPermutation() {
-  // Use Metis to compute a nested dissection permutation of the original matrix
+int Analyse::GetPermutation() {
+  // Compute a fill-reducing permutation of the original matrix, with Metis,
+  // AMD, or both, depending on ordering.
 
   if (!perm.empty()) {
     // permutation already provided by user
-    return;
+    return ret_ok;
   }
 
-  perm.resize(n);
-  iperm.resize(n);
-
-  // Build temporary full copy of the matrix, to be used for Metis.
+  // Build temporary full copy of the matrix, to be used for the ordering.
   // NB: Metis adjacency list should not contain the vertex itself, so diagonal
   // element is skipped.
 
@@ -105,14 +108,73 @@ void Analyse::GetPermutation() {
     }
   }
 
-  // call Metis
-  int options[METIS_NOPTIONS];
-  METIS_SetDefaultOptions(options);
-  int status = METIS_NodeND(&n, temp_ptr.data(), temp_rows.data(), NULL,
-                            options, perm.data(), iperm.data());
-  assert(status == METIS_OK);
+  // AMD is computed first, because Metis may modify the arrays
+  std::vector<int> perm_amd, iperm_amd;
+  if (ordering != OrderType::Metis) {
+    const int status = AmdOrder(n, temp_ptr, temp_rows, perm_amd, iperm_amd);
+    if (status) return status;
+  }
+
+  // call Metis.
+  // For large matrices, the top levels of the dissection are computed first,
+  // so that Metis can order the resulting subgraphs in parallel. Twice as many
+  // subgraphs as threads are created, to balance the load.
+  std::vector<int> perm_metis, iperm_metis;
+  if (ordering != OrderType::Amd) {
+    const int n_threads = std::max(1u, std::thread::hardware_concurrency());
+    int status;
+    if (n_threads > 1 && n >= parallel_order_size) {
+      const int levels = std::ceil(std::log2(n_threads)) + 1;
+      Scheduler pool(n_threads);
+      status = ParallelNestedDissection(n, temp_ptr, temp_rows, levels,
+                                        MetisOrder, pool, perm_metis,
+                                        iperm_metis);
+    } else {
+      status = MetisOrder(n, temp_ptr, temp_rows, perm_metis, iperm_metis);
+    }
+    if (status) return status;
+  }
+
+  bool use_amd = ordering == OrderType::Amd;
+  if (ordering == OrderType::Auto) {
+    ops_metis = PredictOperations(perm_metis, iperm_metis);
+    ops_amd = PredictOperations(perm_amd, iperm_amd);
+    use_amd = ops_amd < ops_metis;
+  }
+
+  if (use_amd) {
+    perm = std::move(perm_amd);
+    iperm = std::move(iperm_amd);
+  } else {
+    perm = std::move(perm_metis);
+    iperm = std::move(iperm_metis);
+  }
 
   metis_order = iperm;
+  return ret_ok;
+}
+
+double Analyse::PredictOperations(const std::vector<int>& perm_input,
+                                  const std::vector<int>& iperm_input) {
+  // Number of operations of the factorisation with the given ordering, before
+  // the amalgamation of supernodes, as computed by ColCount.
+  // The matrix is permuted and then restored, so that the ordering chosen can
+  // be applied by Run as usual.
+
+  std::vector<int> ptr_upper(ptrUpper);
+  std::vector<int> rows_upper(rowsUpper);
+
+  perm = perm_input;
+  iperm = iperm_input;
+  Permute(iperm);
+  ETree();
+  Postorder();
+  ColCount();
+
+  ptrUpper = std::move(ptr_upper);
+  rowsUpper = std::move(rows_upper);
+
+  return operationsNorelax;
 }
 
 void Analyse::Permute(const std::vector<int>& iperm) {
@@ -873,10 +935,26 @@ void Analyse::RelativeIndClique() {
   // Find the relative indices of the child clique wrt the frontal matrix of the
   // parent supernode
 
-  relindClique.resize(snCount);
-  consecutiveSums.resize(snCount);
+  // The indices of all supernodes are stored contiguously, so the size of the
+  // clique of each supernode is needed first. Supernodes without a parent have
+  // no relative indices.
+  relindCliquePtr.assign(snCount + 1, 0);
+  for (int sn = 0; sn < snCount; ++sn) {
+    int sn_clique_size{};
+    if (snParent[sn] != -1) {
+      sn_clique_size =
+          ptrLsn[sn + 1] - ptrLsn[sn] - (snStart[sn + 1] - snStart[sn]);
+    }
+    relindCliquePtr[sn + 1] = relindCliquePtr[sn] + sn_clique_size;
+  }
+  relindClique.resize(relindCliquePtr.back());
+
+  cliqueRuns.clear();
+  cliqueRunsPtr.assign(snCount + 1, 0);
 
   for (int sn = 0; sn < snCount; ++sn) {
+    cliqueRunsPtr[sn] = cliqueRuns.size();
+
     // if there is no parent, skip supernode
     if (snParent[sn] == -1) continue;
 
@@ -895,7 +973,8 @@ void Analyse::RelativeIndClique() {
     // count number of assembly operations during factorize
     operationsAssembly += sn_clique_size * (sn_clique_size + 1) / 2;
 
-    relindClique[sn].resize(sn_clique_size);
+    // relative indices of the clique of sn
+    int* relind = &relindClique[relindCliquePtr[sn]];
 
     // iterate through the clique of sn
     int ptr_current = ptrLsn[sn] + sn_size;
@@ -920,7 +999,7 @@ void Analyse::RelativeIndClique() {
       // check if indices coincide
       if (rowsLsn[ptr_current] == rowsLsn[ptr_parent]) {
         // yes: save relative index and move pointers forward
-        relindClique[sn][index] = ptr_parent - ptr_parent_start;
+        relind[index] = ptr_parent - ptr_parent_start;
         ++index;
         ++ptr_parent;
         ++ptr_current;
@@ -930,25 +1009,18 @@ void Analyse::RelativeIndClique() {
       }
     }
 
-    // Difference between consecutive relative indices.
-    // Useful to detect chains of consecutive indices.
-    consecutiveSums[sn].resize(sn_clique_size);
-    for (int i = 0; i < sn_clique_size - 1; ++i) {
-      consecutiveSums[sn][i] = relindClique[sn][i + 1] - relindClique[sn][i];
-    }
-
-    // Number of consecutive sums that can be done in one blas call.
-    consecutiveSums[sn].back() = 1;
-    for (int i = sn_clique_size - 2; i >= 0; --i) {
-      if (consecutiveSums[sn][i] > 1) {
-        consecutiveSums[sn][i] = 1;
-      } else if (consecutiveSums[sn][i] == 1) {
-        consecutiveSums[sn][i] = consecutiveSums[sn][i + 1] + 1;
+    // Split the relative indices into runs of consecutive indices, so that
+    // the assembly can sum each run with a single loop.
+    for (int i = 0; i < sn_clique_size; ++i) {
+      if (i > 0 && relind[i] == relind[i - 1] + 1) {
+        ++cliqueRuns.back().length;
       } else {
-        printf("Error in consecutiveSums %d\n", consecutiveSums[sn][i]);
+        cliqueRuns.push_back({i, relind[i], 1});
       }
     }
   }
+  cliqueRunsPtr[snCount] = cliqueRuns.size();
+  cliqueRuns.shrink_to_fit();
 }
 
 bool Analyse::Check() const {
@@ -1039,8 +1111,12 @@ void Analyse::PrintTimes() const {
   printf("\t\tAnalyse\n");
   printf("----------------------------------------------------\n");
   printf("\nAnalyse time            \t%8.4f\n", time_total);
-  printf("\tMetis:                  %8.4f (%4.1f%%)\n", time_metis,
+  printf("\tOrdering:               %8.4f (%4.1f%%)\n", time_metis,
          time_metis / time_total * 100);
+  if (ordering == OrderType::Auto && ops_metis + ops_amd > 0) {
+    printf("\t  Metis %.2e, AMD %.2e operations, using %s\n", ops_metis,
+           ops_amd, ops_amd < ops_metis ? "AMD" : "Metis");
+  }
   printf("\tTree:                   %8.4f (%4.1f%%)\n", time_tree,
          time_tree / time_total * 100);
   printf("\tCounts:                 %8.4f (%4.1f%%)\n", time_count,
@@ -1057,20 +1133,24 @@ void Analyse::PrintTimes() const {
          time_layer0 / time_total * 100);
 }
 
-void Analyse::Run(Symbolic& S) {
+int Analyse::Run(Symbolic& S) {
   // Perform analyse phase and store the result into the symbolic object S.
   // After Run returns, the Analyse object is not valid.
 
-  if (!ready) return;
+  if (!ready) return ret_invalid_input;
 
   Clock clock0{};
   clock0.start();
 
   Clock clock{};
 
+  // an ordering given by the user is not recorded in S
+  const bool order_given = !perm.empty();
+
   clock.start();
-  GetPermutation();
+  const int status = GetPermutation();
   time_metis = clock.stop();
+  if (status) return status;
 
   clock.start();
   Permute(iperm);
@@ -1102,7 +1182,8 @@ void Analyse::Run(Symbolic& S) {
   time_relind = clock.stop();
 
   clock.start();
-  GenerateLayer0(4, 0.7);
+  GenerateLayer0(std::max(1u, std::thread::hardware_concurrency()),
+                 k_imbalance_ratio);
   time_layer0 = clock.stop();
 
   time_total = clock0.stop();
@@ -1111,6 +1192,8 @@ void Analyse::Run(Symbolic& S) {
 
   // move relevant stuff into S
   S.type = type;
+  S.packed = packed;
+  S.ordering = order_given ? -1 : (int)ordering;
   S.n = n;
   S.nz = nzL;
   S.fillin = (double)nzL / nz;
@@ -1134,10 +1217,24 @@ void Analyse::Run(Symbolic& S) {
   S.snStart = std::move(snStart);
   S.relindCols = std::move(relindCols);
   S.relindClique = std::move(relindClique);
-  S.consecutiveSums = std::move(consecutiveSums);
+  S.relindCliquePtr = std::move(relindCliquePtr);
+  S.cliqueRuns = std::move(cliqueRuns);
+  S.cliqueRunsPtr = std::move(cliqueRunsPtr);
+  S.layer0 = std::move(layer0);
+  S.layer0Start = std::move(layer0Start);
+  S.threads = threads;
+
+  return ret_ok;
 }
 
 void Analyse::GenerateLayer0(int n_threads, double imbalance_ratio) {
+  // Find a set of independent subtrees (layer0) that can be assigned to
+  // n_threads threads, with a ratio between the least and most loaded thread
+  // of at least imbalance_ratio, if possible.
+  // The supernodes above layer0 are processed after all the subtrees.
+
+  threads = n_threads;
+
   // linked lists of children
   std::vector<int> head, next;
   ChildrenLinkedList(snParent, head, next);
@@ -1167,7 +1264,7 @@ void Analyse::GenerateLayer0(int n_threads, double imbalance_ratio) {
   }
 
   // keep track of nodes in layer0
-  std::vector<int> layer0{};
+  layer0.clear();
 
   // compute number of operations to process each subtree
   std::vector<double> subtree_ops(snCount, 0.0);
@@ -1238,6 +1335,19 @@ void Analyse::GenerateLayer0(int n_threads, double imbalance_ratio) {
 
   printf("Left / total %%: %.2f\n", ops_left / total_ops * 100);
   printf("Speedup: %.2f\n\n", total_ops / (ops_left + max_load));
+
+  // expensive subtrees are processed first
+  std::sort(layer0.begin(), layer0.end(),
+            [&](int a, int b) { return subtree_ops[a] > subtree_ops[b]; });
+
+  // Supernodes are postordered, so each subtree is made of consecutive
+  // supernodes, ending with the root.
+  std::vector<int> subtree_sizes;
+  SubtreeSize(snParent, subtree_sizes);
+  layer0Start.resize(layer0.size());
+  for (int i = 0; i < layer0.size(); ++i) {
+    layer0Start[i] = layer0[i] - subtree_sizes[layer0[i]] + 1;
+  }
 }
 
 void Analyse::ReorderChildren() {
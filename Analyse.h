@@ -15,6 +15,12 @@ const double k_upper_ratio_relax = 0.02;
 const double k_lower_ratio_relax = 0.01;
 const int k_max_iter_relax = 10;
 
+// parameters for tree parallelism
+const double k_imbalance_ratio = 0.7;
+
+// matrices with at least this many rows are ordered by Metis in parallel
+const int k_parallel_order_size = 100000;
+
 // Class to perform the analyse phase of the factorization.
 // The final symbolic factorization is stored in an object of type Symbolic.
 class Analyse {
@@ -31,9 +37,13 @@ class Analyse {
   double operations{};
   double operationsNorelax{};
   double operationsAssembly{};
+
+  // operations predicted for the two orderings, with OrderType::Auto
+  double ops_metis{};
+  double ops_amd{};
   FactType type{};
 
-  // Permutation and inverse permutation from Metis
+  // Permutation and inverse permutation
   std::vector<int> perm{};
   std::vector<int> iperm{};
 
@@ -68,15 +78,24 @@ class Analyse {
   std::vector<int> relindCols{};
 
   // relative indices of clique wrt parent
-  std::vector<std::vector<int>> relindClique{};
+  std::vector<int> relindClique{};
+  std::vector<int> relindCliquePtr{};
 
-  // information about consecutive indices in relindClique
-  std::vector<std::vector<int>> consecutiveSums{};
+  // runs of consecutive indices in relindClique
+  std::vector<CliqueRun> cliqueRuns{};
+  std::vector<int> cliqueRunsPtr{};
 
   // estimate of maximum storage
   double maxStorage{};
 
-  void GetPermutation();
+  // independent subtrees for parallel factorisation
+  std::vector<int> layer0{};
+  std::vector<int> layer0Start{};
+  int threads{};
+
+  int GetPermutation();
+  double PredictOperations(const std::vector<int>& perm_input,
+                           const std::vector<int>& iperm_input);
   void Permute(const std::vector<int>& iperm);
   void ETree();
   void Postorder();
@@ -100,10 +119,22 @@ class Analyse {
   Analyse(const std::vector<int>& rows_input, const std::vector<int>& ptr_input,
           FactType type_input, const std::vector<int>& order = {});
 
-  // Run analyse phase and save the result in Symbolic object S
-  void Run(Symbolic& S);
+  // Run analyse phase and save the result in Symbolic object S.
+  // Return ret_ok, or the ret_value of the error.
+  int Run(Symbolic& S);
+
+  // format of the frontal matrices to use in the factorisation
+  PackType packed = PackType::Hybrid;
+
+  // ordering to use, if no ordering is given to the constructor
+  OrderType ordering = OrderType::Metis;
+
+  // Metis is run on independent subgraphs in parallel (see
+  // ParallelNestedDissection) for matrices with at least this many rows, if
+  // more than one thread is available
+  int parallel_order_size = k_parallel_order_size;
 
-  // times
+  // times (time_metis is the time of the ordering, whichever is used)
   double time_metis{};
   double time_tree{};
   double time_count{};
@@ -114,7 +145,7 @@ class Analyse {
   double time_total{};
   double time_layer0{};
 
-  // save metis iperm to be used by hsl codes for comparison
+  // save iperm of the ordering to be used by hsl codes for comparison
   std::vector<int> metis_order{};
 };
 
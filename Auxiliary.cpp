@@ -2,6 +2,10 @@
 
 #include <stack>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 void Counts2Ptr(std::vector<int>& ptr, std::vector<int>& w) {
   // Given the column counts in the vector w (of size n),
   // compute the column pointers in the vector ptr (of size n+1),
@@ -66,35 +70,6 @@ void Transpose(const std::vector<int>& ptr, const std::vector<int>& rows,
   }
 }
 
-void Transpose(const std::vector<int>& ptr, const std::vector<int>& rows,
-               const std::vector<double>& val, std::vector<int>& ptrT,
-               std::vector<int>& rowsT, std::vector<double>& valT) {
-  // Compute the transpose of the matrix and return it in rowsT, ptrT and valT
-
-  int n = ptr.size() - 1;
-
-  std::vector<int> work(n);
-
-  // count the entries in each row into work
-  for (int i = 0; i < ptr.back(); ++i) {
-    ++work[rows[i]];
-  }
-
-  // sum row sums to obtain pointers
-  Counts2Ptr(ptrT, work);
-
-  for (int j = 0; j < n; ++j) {
-    for (int el = ptr[j]; el < ptr[j + 1]; ++el) {
-      int i = rows[el];
-
-      // entry (i,j) becomes entry (j,i)
-      int pos = work[i]++;
-      rowsT[pos] = j;
-      valT[pos] = val[el];
-    }
-  }
-}
-
 void ChildrenLinkedList(const std::vector<int>& parent, std::vector<int>& head,
                         std::vector<int>& next) {
   // Create linked lists of children in elimination tree.
@@ -183,9 +158,29 @@ void ProcessEdge(int j, int i, const std::vector<int>& first,
   prevleaf[i] = j;
 }
 
-void Clock::start() { t0 = std::chrono::high_resolution_clock::now(); }
+void Clock::start() { t0 = std::chrono::steady_clock::now(); }
 double Clock::stop() {
-  auto t1 = std::chrono::high_resolution_clock::now();
+  auto t1 = std::chrono::steady_clock::now();
   std::chrono::duration<double> d = t1 - t0;
   return d.count();
 }
+
+FlushToZero::FlushToZero() {
+#if defined(__SSE__)
+  // flush-to-zero (bit 15) and denormals-are-zero (bit 6) of MXCSR
+  saved = _mm_getcsr();
+  _mm_setcsr(saved | 0x8040);
+#elif defined(__aarch64__)
+  // flush-to-zero (bit 24) of FPCR
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(saved));
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(saved | (1ULL << 24)));
+#endif
+}
+
+FlushToZero::~FlushToZero() {
+#if defined(__SSE__)
+  _mm_setcsr(saved);
+#elif defined(__aarch64__)
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(saved));
+#endif
+}
@@ -11,9 +11,6 @@ void InversePerm(const std::vector<int>& perm, std::vector<int>& iperm);
 void SubtreeSize(const std::vector<int>& parent, std::vector<int>& sizes);
 void Transpose(const std::vector<int>& ptr, const std::vector<int>& rows,
                std::vector<int>& ptrT, std::vector<int>& rowsT);
-void Transpose(const std::vector<int>& ptr, const std::vector<int>& rows,
-               const std::vector<double>& val, std::vector<int>& ptrT,
-               std::vector<int>& rowsT, std::vector<double>& valT);
 void ChildrenLinkedList(const std::vector<int>& parent, std::vector<int>& head,
                         std::vector<int>& next);
 void Dfs_post(int node, int& start, std::vector<int>& head,
@@ -22,6 +19,36 @@ void ProcessEdge(int j, int i, const std::vector<int>& first,
           std::vector<int>& maxfirst, std::vector<int>& delta,
           std::vector<int>& prevleaf, std::vector<int>& ancestor);
 
+template <typename T>
+void Transpose(const std::vector<int>& ptr, const std::vector<int>& rows,
+               const std::vector<T>& val, std::vector<int>& ptrT,
+               std::vector<int>& rowsT, std::vector<T>& valT) {
+  // Compute the transpose of the matrix and return it in rowsT, ptrT and valT
+
+  int n = ptr.size() - 1;
+
+  std::vector<int> work(n);
+
+  // count the entries in each row into work
+  for (int i = 0; i < ptr.back(); ++i) {
+    ++work[rows[i]];
+  }
+
+  // sum row sums to obtain pointers
+  Counts2Ptr(ptrT, work);
+
+  for (int j = 0; j < n; ++j) {
+    for (int el = ptr[j]; el < ptr[j + 1]; ++el) {
+      int i = rows[el];
+
+      // entry (i,j) becomes entry (j,i)
+      int pos = work[i]++;
+      rowsT[pos] = j;
+      valT[pos] = val[el];
+    }
+  }
+}
+
 template <typename T>
 void PermuteVector(std::vector<T>& v, const std::vector<int>& perm) {
   // Permute vector v according to permutation perm.
@@ -45,13 +72,28 @@ void Print(std::ofstream& out_file, const std::vector<T>& v,
 }
 
 class Clock {
-  std::chrono::high_resolution_clock::time_point t0;
+  std::chrono::steady_clock::time_point t0;
 
  public:
   void start();
   double stop();
 };
 
+// While an object of this class exists, the calling thread flushes subnormal
+// numbers to zero, in input and output of floating point operations.
+// Arithmetic with subnormals is very slow and they are common in single
+// precision. Threads created by the BLAS library are not affected.
+// Only available on x86 (SSE) and ARM64; elsewhere it does nothing.
+class FlushToZero {
+  unsigned long long saved{};
+
+ public:
+  FlushToZero();
+  ~FlushToZero();
+  FlushToZero(const FlushToZero&) = delete;
+  FlushToZero& operator=(const FlushToZero&) = delete;
+};
+
 // declaration for Lapack dpotrf
 extern "C" void dpotrf_(char* uplo, int* n, double* A, int* ldA, int* info);
 
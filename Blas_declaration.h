@@ -37,6 +37,24 @@ void dtrsm_(const char* side, const char* uplo, const char* trans,
             const char* diag, const int* m, const int* n, const double* alpha,
             const double* a, const int* lda, double* b, const int* ldb);
 
+// single precision
+void scopy_(const int* n, const float* dx, const int* incx, float* dy,
+            const int* incy);
+void sscal_(const int* n, const float* da, float* dx, const int* incx);
+void sgemv_(const char* trans, const int* m, const int* n, const float* alpha,
+            const float* A, const int* lda, const float* x, const int* incx,
+            const float* beta, float* y, const int* incy);
+void sgemm_(const char* transa, const char* transb, const int* m, const int* n,
+            const int* k, const float* alpha, const float* A, const int* lda,
+            const float* B, const int* ldb, const float* beta, float* C,
+            const int* ldc);
+void ssyrk_(const char* uplo, const char* trans, const int* n, const int* k,
+            const float* alpha, const float* a, const int* lda,
+            const float* beta, float* c, const int* ldc);
+void strsm_(const char* side, const char* uplo, const char* trans,
+            const char* diag, const int* m, const int* n, const float* alpha,
+            const float* a, const int* lda, float* b, const int* ldb);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,92 @@
+#include "CliqueStack.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Memory.h"
+
+void CliqueStack::Init(size_t size) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // memory is kept if the stack is already large enough
+  if (stack.size() < size) stack.resize(size);
+  cliques.clear();
+  peak = 0;
+  heap_allocations = 0;
+}
+
+size_t CliqueStack::Top() const {
+  return cliques.empty() ? 0 : cliques.back().start + cliques.back().size;
+}
+
+void CliqueStack::PopReleased() {
+  while (!cliques.empty() && cliques.back().released) cliques.pop_back();
+}
+
+bool CliqueStack::InStack(const double* clique) const {
+  return !stack.empty() && clique >= stack.data() &&
+         clique < stack.data() + stack.size();
+}
+
+int CliqueStack::Find(const double* clique) const {
+  // cliques are usually close to the top, so search backwards
+  const size_t start = clique - stack.data();
+  for (int i = cliques.size() - 1; i >= 0; --i) {
+    if (cliques[i].start == start) return i;
+  }
+  return -1;
+}
+
+double* CliqueStack::Push(size_t size) {
+  std::lock_guard<std::mutex> lock(mutex);
+  PopReleased();
+
+  const size_t start = Top();
+  if (start + size > stack.size()) {
+    ++heap_allocations;
+    return static_cast<double*>(Mem_Malloc(mem_cliques, size * sizeof(double)));
+  }
+
+  cliques.push_back({start, size, false});
+  peak = std::max(peak, start + size);
+  return &stack[start];
+}
+
+void CliqueStack::Release(double* clique) {
+  if (!InStack(clique)) {
+    Mem_Free(clique);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const int i = Find(clique);
+  if (i >= 0) cliques[i].released = true;
+  PopReleased();
+}
+
+double* CliqueStack::Compact(double* clique) {
+  if (!InStack(clique)) return clique;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const int i = Find(clique);
+  if (i < 0) return clique;
+
+  // find the released cliques immediately below clique
+  int first = i;
+  while (first > 0 && cliques[first - 1].released) --first;
+  if (first == i) return clique;
+
+  // move clique down, into the space of the released cliques
+  const size_t new_start = cliques[first].start;
+  const size_t size = cliques[i].size;
+  std::memmove(&stack[new_start], clique, size * sizeof(double));
+
+  cliques[first] = {new_start, size, false};
+  cliques.erase(cliques.begin() + first + 1, cliques.begin() + i + 1);
+
+  return &stack[new_start];
+}
+
+size_t CliqueStack::Capacity() const { return stack.size(); }
+size_t CliqueStack::Peak() const { return peak; }
+int CliqueStack::HeapAllocations() const { return heap_allocations; }
@@ -0,0 +1,61 @@
+#ifndef CLIQUE_STACK_H
+#define CLIQUE_STACK_H
+
+#include <mutex>
+#include <vector>
+
+// Stack of memory for the Schur contributions (cliques) of the supernodes.
+// Each thread owns a stack, where it pushes the cliques of the supernodes that
+// it processes. When supernodes are processed in postorder, the cliques of the
+// children of a supernode are on top of the stack when the supernode is
+// processed. Once they have been assembled, they are released and the clique of
+// the supernode is moved down to take their place.
+// A clique may be released by a thread different from the owner of the stack;
+// its space is recovered when it reaches the top of the stack, or when a clique
+// above it is compacted.
+// If the stack is full, cliques are allocated on the heap, and recorded in
+// mem_cliques.
+class CliqueStack {
+  struct Clique {
+    size_t start;
+    size_t size;
+    bool released;
+  };
+
+  std::vector<double> stack{};
+
+  // cliques currently in the stack, in increasing order of position
+  std::vector<Clique> cliques{};
+
+  // cliques can be released by other threads
+  std::mutex mutex{};
+
+  size_t peak{};
+  int heap_allocations{};
+
+  size_t Top() const;
+  void PopReleased();
+  int Find(const double* clique) const;
+  bool InStack(const double* clique) const;
+
+ public:
+  // allocate space for size doubles
+  void Init(size_t size);
+
+  // get space for a new clique of size doubles on top of the stack
+  double* Push(size_t size);
+
+  // clique is no longer needed
+  void Release(double* clique);
+
+  // move clique down, over the released cliques immediately below it.
+  // Returns the new position of clique.
+  double* Compact(double* clique);
+
+  // memory used, in number of doubles
+  size_t Capacity() const;
+  size_t Peak() const;
+  int HeapAllocations() const;
+};
+
+#endif
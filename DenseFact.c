@@ -6,8 +6,8 @@
 #include <stdlib.h>
 
 #include "DenseFact_declaration.h"
-
-// #define TIMING
+#include "Instrument.h"
+#include "Memory.h"
 
 /*
 Names:
@@ -18,11 +18,39 @@ di: (positive) Definite or Indefinite
 bu: Blocked or Unblocked
 flh: Full format, Lower packed format, or lower-blocked-Hybrid packed format
 
+A suffix _s denotes the single precision version of a kernel.
+
 */
 
-double t0;
+// Check the pivot of column j of the front. A pivot that is not acceptable is
+// replaced by +-delta if static pivoting is used (piv not NULL), and the
+// perturbation is stored in piv->reg[j]. Otherwise, the failure is reported.
+static int StaticPivot(int indef, double* pivot, const DenseFact_piv* piv,
+                       int j) {
+  const double p = *pivot;
+  const double thresh = piv ? piv->thresh : 0.0;
+  const int sign = piv && piv->sign ? piv->sign[j] : 0;
+
+  int bad = isnan(p);
+  if (!indef)
+    bad = bad || p <= thresh;
+  else
+    bad = bad || fabs(p) <= thresh || sign * p < 0.0;
+
+  if (!bad) return ret_ok;
+  if (!piv) return ret_invalid_pivot;
+
+  // use the expected sign if known, otherwise keep the sign of the pivot
+  double s = 1.0;
+  if (indef) s = sign != 0 ? sign : (p < 0.0 ? -1.0 : 1.0);
+
+  *pivot = s * piv->delta;
+  if (piv->reg) piv->reg[j] = isnan(p) ? *pivot : *pivot - p;
+  return ret_ok;
+}
 
-int DenseFact_fduf(char uplo, int n, double* restrict A, int lda) {
+int DenseFact_fduf(char uplo, int n, double* restrict A, int lda,
+                   const DenseFact_piv* piv, int offset) {
   // ===========================================================================
   // Positive definite factorization without blocks.
   // BLAS calls: ddot_, dgemv_, dscal_.
@@ -45,7 +73,7 @@ int DenseFact_fduf(char uplo, int n, double* restrict A, int lda) {
 
       // update diagonal element
       double Ajj = A[j + lda * j] - ddot_(&N, &A[j], &lda, &A[j], &lda);
-      if (Ajj <= 0.0 || isnan(Ajj)) {
+      if (StaticPivot(0, &Ajj, piv, offset + j)) {
         A[j + lda * j] = Ajj;
         printf("\nDenseFact_fduf: invalid pivot\n");
         return ret_invalid_pivot;
@@ -71,7 +99,7 @@ int DenseFact_fduf(char uplo, int n, double* restrict A, int lda) {
       // update diagonal element
       double Ajj =
           A[j + lda * j] - ddot_(&N, &A[lda * j], &i_one, &A[lda * j], &i_one);
-      if (Ajj <= 0.0 || isnan(Ajj)) {
+      if (StaticPivot(0, &Ajj, piv, offset + j)) {
         A[j + lda * j] = Ajj;
         printf("\nDenseFact_fduf: invalid pivot\n");
         return ret_invalid_pivot;
@@ -94,7 +122,8 @@ int DenseFact_fduf(char uplo, int n, double* restrict A, int lda) {
   return ret_ok;
 }
 
-int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
+int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda,
+                   const DenseFact_piv* piv, int offset) {
   // ===========================================================================
   // Infedinite factorization without blocks.
   // BLAS calls: ddot_, dgemv_, dscal_.
@@ -112,7 +141,7 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
   // main operations
   if (uplo == 'L') {
     // allocate space for copy of col multiplied by pivots
-    double* temp = malloc((n - 1) * sizeof(double));
+    double* temp = Mem_Malloc(mem_dense, (n - 1) * sizeof(double));
     if (!temp) {
       printf("\nDenseFact_fiuf: out of memory\n");
       return ret_out_of_memory;
@@ -129,8 +158,9 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
 
       // update diagonal element
       double Ajj = A[j + lda * j] - ddot_(&N, &A[j], &lda, temp, &i_one);
-      if (Ajj == 0.0 || isnan(Ajj)) {
+      if (StaticPivot(1, &Ajj, piv, offset + j)) {
         A[j + lda * j] = Ajj;
+        Mem_Free(temp);
         printf("\nDenseFact_fiuf: invalid pivot\n");
         return ret_invalid_pivot;
       }
@@ -147,10 +177,10 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
       }
     }
     // free temporary copy of row
-    free(temp);
+    Mem_Free(temp);
   } else {
     // allocate space for copy of col multiplied by pivots
-    double* temp = malloc((n - 1) * sizeof(double));
+    double* temp = Mem_Malloc(mem_dense, (n - 1) * sizeof(double));
     if (!temp) {
       printf("\nDenseFact_fiuf: out of memory\n");
       return ret_out_of_memory;
@@ -168,8 +198,9 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
       // update diagonal element
       double Ajj =
           A[j + lda * j] - ddot_(&N, &A[j * lda], &i_one, temp, &i_one);
-      if (Ajj == 0.0 || isnan(Ajj)) {
+      if (StaticPivot(1, &Ajj, piv, offset + j)) {
         A[j + lda * j] = Ajj;
+        Mem_Free(temp);
         printf("\nDenseFact_fiuf: invalid pivot\n");
         return ret_invalid_pivot;
       }
@@ -187,7 +218,7 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
     }
 
     // free temporary copy of row
-    free(temp);
+    Mem_Free(temp);
   }
 
   return ret_ok;
@@ -242,12 +273,15 @@ int DenseFact_fiuf(char uplo, int n, double* restrict A, int lda) {
 // ===========================================================================
 
 int DenseFact_pdbf(int n, int k, int nb, double* restrict A, int lda,
-                   double* restrict B, int ldb, double* times) {
+                   double* restrict B, int ldb, double schur_beta,
+                   const DenseFact_piv* piv, double* times) {
   // ===========================================================================
   // Positive definite factorization with blocks.
   // BLAS calls: dsyrk_, dgemm_, dtrsm_.
   // ===========================================================================
 
+  instr_start t0;
+
   // check input
   if (n < 0 || k < 0 || !A || lda < n || (k < n && (!B || ldb < n - k))) {
     printf("\nDenseFact_pdbf: invalid input\n");
@@ -278,72 +312,51 @@ int DenseFact_pdbf(int n, int k, int nb, double* restrict A, int lda,
     const double* Q = &A[j + N];
     double* R = &A[j + N + lda * j];
 
-// update diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-
+    // update diagonal block
+    Instr_KernelStart(&t0);
     dsyrk_(&LL, &NN, &N, &K, &d_m_one, P, &lda, &d_one, D, &lda);
+    Instr_KernelStop(times, t_dsyrk, &t0);
 
-#ifdef TIMING
-    times[t_dsyrk] += GetTime() - t0;
-#endif
-
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-
-    int info = DenseFact_fduf('L', N, D, lda);
-
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fduf('L', N, D, lda, piv, j);
+    Instr_KernelStop(times, t_fact, &t0);
     if (info != 0) return info;
 
     if (j + jb < n) {
-// update block of columns
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // update block of columns
+      Instr_KernelStart(&t0);
       dgemm_(&NN, &TT, &M, &N, &K, &d_m_one, Q, &lda, P, &lda, &d_one, R, &lda);
-#ifdef TIMING
-      times[t_dgemm] += GetTime() - t0;
-#endif
-
-// solve block of columns with diagonal block
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dgemm, &t0);
+
+      // solve block of columns with diagonal block
+      Instr_KernelStart(&t0);
       dtrsm_(&RR, &LL, &TT, &NN, &M, &N, &d_one, D, &lda, R, &lda);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dtrsm, &t0);
     }
   }
 
   // update Schur complement if partial factorization is required
   if (k < n) {
     const int N = n - k;
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    dsyrk_(&LL, &NN, &N, &k, &d_m_one, &A[k], &lda, &d_zero, B, &ldb);
-#ifdef TIMING
-    times[t_dsyrk] += GetTime() - t0;
-#endif
+    Instr_KernelStart(&t0);
+    dsyrk_(&LL, &NN, &N, &k, &d_m_one, &A[k], &lda, &schur_beta, B, &ldb);
+    Instr_KernelStop(times, t_dsyrk, &t0);
   }
 
   return ret_ok;
 }
 
 int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
-                   double* restrict B, int ldb, double* times) {
+                   double* restrict B, int ldb, double schur_beta,
+                   const DenseFact_piv* piv, double* times) {
   // ===========================================================================
   // Indefinite factorization with blocks.
   // BLAS calls: dcopy_, dscal_, dgemm_, dtrsm_, dsyrk_
   // ===========================================================================
 
+  instr_start t0;
+
   // check input
   if (n < 0 || k < 0 || !A || lda < n || (k < n && (!B || ldb < n - k))) {
     printf("\nDenseFact_pibf: invalid input\n");
@@ -370,7 +383,7 @@ int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
     double* R = &A[j + N + lda * j];
 
     // create temporary copy of block of rows, multiplied by pivots
-    double* T = malloc(j * jb * sizeof(double));
+    double* T = Mem_Malloc(mem_dense, j * jb * sizeof(double));
     if (!T) {
       printf("\nDenseFact_pibf: out of memory\n");
       return ret_out_of_memory;
@@ -381,43 +394,30 @@ int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
       dscal_(&N, &A[i + i * lda], &T[i * ldt], &i_one);
     }
 
-// update diagonal block using dgemm_
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // update diagonal block using dgemm_
+    Instr_KernelStart(&t0);
     dgemm_(&NN, &TT, &jb, &jb, &j, &d_m_one, P, &lda, T, &ldt, &d_one, D, &lda);
-#ifdef TIMING
-    times[t_dgemm] += GetTime() - t0;
-#endif
-
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    int info = DenseFact_fiuf('L', N, D, lda);
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
-    if (info != 0) return info;
+    Instr_KernelStop(times, t_dgemm, &t0);
+
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fiuf('L', N, D, lda, piv, j);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(T);
+      return info;
+    }
 
     if (j + jb < n) {
-// update block of columns
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // update block of columns
+      Instr_KernelStart(&t0);
       dgemm_(&NN, &TT, &M, &N, &K, &d_m_one, Q, &lda, T, &ldt, &d_one, R, &lda);
-#ifdef TIMING
-      times[t_dgemm] += GetTime() - t0;
-#endif
-
-// solve block of columns with L
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dgemm, &t0);
+
+      // solve block of columns with L
+      Instr_KernelStart(&t0);
       dtrsm_(&RR, &LL, &TT, &UU, &M, &N, &d_one, D, &lda, R, &lda);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dtrsm, &t0);
 
       // solve block of columns with D
       for (int i = 0; i < jb; ++i) {
@@ -426,7 +426,7 @@ int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
       }
     }
 
-    free(T);
+    Mem_Free(T);
   }
 
   // update Schur complement
@@ -445,13 +445,16 @@ int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
     }
 
     // make temporary copies of positive and negative columns separately
-    double* temp_pos = malloc((n - k) * pos_pivot * sizeof(double));
+    double* temp_pos =
+        Mem_Malloc(mem_dense, (n - k) * pos_pivot * sizeof(double));
     if (!temp_pos) {
       printf("\nDenseFact_pibf: out of memory\n");
       return ret_out_of_memory;
     }
-    double* temp_neg = malloc((n - k) * neg_pivot * sizeof(double));
+    double* temp_neg =
+        Mem_Malloc(mem_dense, (n - k) * neg_pivot * sizeof(double));
     if (!temp_neg) {
+      Mem_Free(temp_pos);
       printf("\nDenseFact_pibf: out of memory\n");
       return ret_out_of_memory;
     }
@@ -479,27 +482,24 @@ int DenseFact_pibf(int n, int k, int nb, double* restrict A, int lda,
 // Update schur complement by subtracting contribution of positive columns
 // and adding contribution of negative columns.
 // In this way, I can use dsyrk_ instead of dgemm_ and avoid updating the
-// full square schur complement. First call uses beta = 0.0, to clear
-// content of B. Second call uses beta = 1.0, to not clear the result of
-// the first call.
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    dsyrk_(&LL, &NN, &N, &pos_pivot, &d_m_one, temp_pos, &ldt, &d_zero, B,
-           &ldb);
+// full square schur complement. First call uses beta = schur_beta, to clear
+// content of B (or to add to it). Second call uses beta = 1.0, to not clear
+// the result of the first call.
+    Instr_KernelStart(&t0);
+    dsyrk_(&LL, &NN, &N, &pos_pivot, &d_m_one, temp_pos, &ldt, &schur_beta,
+           B, &ldb);
     dsyrk_(&LL, &NN, &N, &neg_pivot, &d_one, temp_neg, &ldt, &d_one, B, &ldb);
-#ifdef TIMING
-    times[t_dsyrk] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dsyrk, &t0);
 
-    free(temp_pos);
-    free(temp_neg);
+    Mem_Free(temp_pos);
+    Mem_Free(temp_neg);
   }
 
   return ret_ok;
 }
 
 int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
+                   double schur_beta, const DenseFact_piv* piv,
                    double* times) {
   // ===========================================================================
   // Positive definite factorization with blocks in lower-blocked-hybrid
@@ -508,6 +508,8 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
   // BLAS calls: dsyrk_, dgemm_, dtrsm_, dcopy_
   // ===========================================================================
 
+  instr_start t0;
+
   // check input
   if (n < 0 || k < 0 || !A || (k < n && !B)) {
     printf("\nDenseFact_pdbh: invalid input\n");
@@ -521,7 +523,7 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
   const int n_blocks = (k - 1) / nb + 1;
 
   // start of diagonal blocks
-  int* diag_start = malloc(n_blocks * sizeof(double));
+  int* diag_start = Mem_Malloc(mem_dense, n_blocks * sizeof(double));
   if (!diag_start) {
     printf("\nDenseFact_pdbh: out of memory\n");
     return ret_out_of_memory;
@@ -540,8 +542,9 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
   int info;
 
   // buffer for full-format diagonal blocks
-  double* D = malloc(nb * nb * sizeof(double));
+  double* D = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
   if (!D) {
+    Mem_Free(diag_start);
     printf("\nDenseFact_pdbh: out of memory\n");
     return ret_out_of_memory;
   }
@@ -555,19 +558,15 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
     const int this_diag_size = jb * (jb + 1) / 2;
     const int this_full_size = nb * jb;
 
-// full copy of diagonal block by rows, in D
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // full copy of diagonal block by rows, in D
+    Instr_KernelStart(&t0);
     int offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &A[diag_start[j] + offset], &i_one, &D[Drow * jb], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
 
     // number of rows left below block j
     const int M = n - nb * j - jb;
@@ -582,65 +581,49 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
       if (j > k + 1) Pk_pos += full_size * (j - k - 1);
       const double* Pk = &A[Pk_pos];
 
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStart(&t0);
       dsyrk_(&UU, &TT, &jb, &nb, &d_m_one, Pk, &nb, &d_one, D, &jb);
-#ifdef TIMING
-      times[t_dsyrk] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dsyrk, &t0);
 
       if (M > 0) {
         const int Qk_pos = Pk_pos + this_full_size;
         const double* Qk = &A[Qk_pos];
 
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dgemm_(&TT, &NN, &jb, &M, &nb, &d_m_one, Pk, &nb, Qk, &nb, &d_one, R,
                &jb);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
       }
     }
 
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    int info = DenseFact_fduf('U', jb, D, jb);
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
-    if (info != 0) return info;
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fduf('U', jb, D, jb, piv, j * nb);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(D);
+      Mem_Free(diag_start);
+      return info;
+    }
 
     if (M > 0) {
-// solve block of columns with diagonal block
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // solve block of columns with diagonal block
+      Instr_KernelStart(&t0);
       dtrsm_(&LL, &UU, &TT, &NN, &jb, &M, &d_one, D, &jb, R, &jb);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dtrsm, &t0);
     }
 
-// put D back into packed format
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // put D back into packed format
+    Instr_KernelStart(&t0);
     offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &D[Drow * jb], &i_one, &A[diag_start[j] + offset], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
   }
-  free(D);
+  Mem_Free(D);
 
   // compute Schur complement if partial factorization is required
   if (k < n) {
@@ -654,8 +637,9 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
     double beta = 0.0;
 
     // buffer for full-format of block of columns of Schur complement
-    double* schur_buf = malloc(ns * nb * sizeof(double));
+    double* schur_buf = Mem_Malloc(mem_dense, ns * nb * sizeof(double));
     if (!schur_buf) {
+      Mem_Free(diag_start);
       printf("\nDenseFact_pdbh: out of memory\n");
       return ret_out_of_memory;
     }
@@ -694,28 +678,20 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
         }
         diag_pos += sb * this_full_size;
 
-// update diagonal block
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        // update diagonal block
+        Instr_KernelStart(&t0);
         dsyrk_(&UU, &TT, &ncol, &jb, &d_m_one, &A[diag_pos], &jb, &beta,
                schur_buf, &ncol);
-#ifdef TIMING
-        times[t_dsyrk] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dsyrk, &t0);
 
         // update subdiagonal part
         const int M = nrow - nb;
         if (M > 0) {
-#ifdef TIMING
-          t0 = GetTime();
-#endif
+          Instr_KernelStart(&t0);
           dgemm_(&TT, &NN, &nb, &M, &jb, &d_m_one, &A[diag_pos], &jb,
                  &A[diag_pos + this_full_size], &jb, &beta,
                  &schur_buf[ncol * ncol], &ncol);
-#ifdef TIMING
-          times[t_dgemm] += GetTime() - t0;
-#endif
+          Instr_KernelStop(times, t_dgemm, &t0);
         }
 
         // beta is 0 for the first time (to avoid initializing schur_buf) and
@@ -724,31 +700,32 @@ int DenseFact_pdbh(int n, int k, int nb, double* restrict A, double* restrict B,
       }
 
 // schur_buf contains Schur complement in hybrid format (with full
-// diagonal blocks). Put it in lower-packed format in B.
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+// diagonal blocks). Put it in lower-packed format in B, or add it to B.
+      Instr_KernelStart(&t0);
       for (int buf_row = 0; buf_row < nrow; ++buf_row) {
         const int N = ncol;
-        dcopy_(&N, &schur_buf[buf_row * ncol], &i_one, &B[B_start + buf_row],
-               &nrow);
+        if (schur_beta == 0.0) {
+          dcopy_(&N, &schur_buf[buf_row * ncol], &i_one, &B[B_start + buf_row],
+                 &nrow);
+        } else {
+          daxpy_(&N, &d_one, &schur_buf[buf_row * ncol], &i_one,
+                 &B[B_start + buf_row], &nrow);
+        }
       }
       B_start += nrow * ncol;
-
-#ifdef TIMING
-      times[t_dcopy_schur] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dcopy_schur, &t0);
     }
 
-    free(schur_buf);
+    Mem_Free(schur_buf);
   }
 
-  free(diag_start);
+  Mem_Free(diag_start);
 
   return ret_ok;
 }
 
 int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
+                   double schur_beta, const DenseFact_piv* piv,
                    double* times) {
   // ===========================================================================
   // Indefinite factorization with blocks in lower-blocked-hybrid format.
@@ -757,6 +734,8 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
   // dsyrk_, dgemm_, dtrsm_, dcopy_, dscal_
   // ===========================================================================
 
+  instr_start t0;
+
   const int sizeA = n * k - k * (k - 1) / 2;
 
   // check input
@@ -772,7 +751,7 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
   const int n_blocks = (k - 1) / nb + 1;
 
   // start of diagonal blocks
-  int* diag_start = malloc(n_blocks * sizeof(double));
+  int* diag_start = Mem_Malloc(mem_dense, n_blocks * sizeof(double));
   if (!diag_start) {
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
@@ -791,15 +770,18 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
   int info;
 
   // buffer for full-format diagonal blocks
-  double* D = malloc(nb * nb * sizeof(double));
+  double* D = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
   if (!D) {
+    Mem_Free(diag_start);
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
   }
 
   // buffer for copy of block scaled by pivots
-  double* T = malloc(nb * nb * sizeof(double) + 10);
+  double* T = Mem_Malloc(mem_dense, nb * nb * sizeof(double) + 10);
   if (!T) {
+    Mem_Free(D);
+    Mem_Free(diag_start);
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
   }
@@ -813,19 +795,15 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
     const int this_diag_size = jb * (jb + 1) / 2;
     const int this_full_size = nb * jb;
 
-// full copy of diagonal block by rows, in D
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // full copy of diagonal block by rows, in D
+    Instr_KernelStart(&t0);
     int offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &A[diag_start[j] + offset], &i_one, &D[Drow * jb], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
 
     // number of rows left below block j
     const int M = n - nb * j - jb;
@@ -841,103 +819,76 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
       if (j > k + 1) Pk_pos += full_size * (j - k - 1);
       const double* Pk = &A[Pk_pos];
 
-// copy block jk into temp
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // copy block jk into temp
+      Instr_KernelStart(&t0);
       dcopy_(&this_full_size, Pk, &i_one, T, &i_one);
-#ifdef TIMING
-      times[t_dcopy] += GetTime() - t0;
-#endif
-
-// scale temp by pivots
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dcopy, &t0);
+
+      // scale temp by pivots
+      Instr_KernelStart(&t0);
       int pivot_pos = diag_start[k];
       for (int col = 0; col < nb; ++col) {
         dscal_(&jb, &A[pivot_pos], &T[col], &nb);
         pivot_pos += col + 2;
       }
-#ifdef TIMING
-      times[t_dscal] += GetTime() - t0;
-#endif
-
-// update diagonal block with dgemm_
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dscal, &t0);
+
+      // update diagonal block with dgemm_
+      Instr_KernelStart(&t0);
       dgemm_(&TT, &NN, &jb, &jb, &nb, &d_m_one, T, &nb, Pk, &nb, &d_one, D,
              &jb);
-#ifdef TIMING
-      times[t_dgemm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dgemm, &t0);
 
       // update rectangular block
       if (M > 0) {
         const int Qk_pos = Pk_pos + this_full_size;
         const double* Qk = &A[Qk_pos];
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dgemm_(&TT, &NN, &jb, &M, &nb, &d_m_one, T, &nb, Qk, &nb, &d_one, R,
                &jb);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
       }
     }
 
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    int info = DenseFact_fiuf('U', jb, D, jb);
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
-    if (info != 0) return info;
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fiuf('U', jb, D, jb, piv, j * nb);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(T);
+      Mem_Free(D);
+      Mem_Free(diag_start);
+      return info;
+    }
 
     if (M > 0) {
-// solve block of columns with diagonal block
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // solve block of columns with diagonal block
+      Instr_KernelStart(&t0);
       dtrsm_(&LL, &UU, &TT, &UU, &jb, &M, &d_one, D, &jb, R, &jb);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
-
-// scale columns by pivots
-#ifdef TIMING
-      t0 = GetTime();
-#endif
-      int pivot_pos = diag_start[j];
+      Instr_KernelStop(times, t_dtrsm, &t0);
+
+      // scale columns by pivots
+      Instr_KernelStart(&t0);
+      // pivots are taken from D, since A still holds the diagonal block
+      // before the factorization
       for (int col = 0; col < jb; ++col) {
-        const double coeff = 1.0 / A[pivot_pos];
+        const double coeff = 1.0 / D[col + col * jb];
         dscal_(&M, &coeff, &A[R_pos + col], &jb);
-        pivot_pos += col + 2;
       }
-#ifdef TIMING
-      times[t_dscal] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dscal, &t0);
     }
 
-// put D back into packed format
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // put D back into packed format
+    Instr_KernelStart(&t0);
     offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &D[Drow * jb], &i_one, &A[diag_start[j] + offset], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
   }
-  free(D);
+  Mem_Free(D);
 
   // compute Schur complement if partial factorization is required
   if (k < n) {
@@ -951,8 +902,10 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
     double beta = 0.0;
 
     // buffer for full-format of block of columns of Schur complement
-    double* schur_buf = malloc(ns * nb * sizeof(double) + 10);
+    double* schur_buf = Mem_Malloc(mem_dense, ns * nb * sizeof(double) + 10);
     if (!schur_buf) {
+      Mem_Free(T);
+      Mem_Free(diag_start);
       printf("\nDenseFact_pibh: out of memory\n");
       return ret_out_of_memory;
     }
@@ -993,50 +946,33 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
 
         // create copy of block, multiplied by pivots
         const int N = ncol * jb;
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dcopy_(&N, &A[diag_pos], &i_one, T, &i_one);
-#ifdef TIMING
-        times[t_dcopy] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dcopy, &t0);
         int pivot_pos = diag_start[j];
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         for (int col = 0; col < jb; ++col) {
           dscal_(&ncol, &A[pivot_pos], &T[col], &jb);
           pivot_pos += col + 2;
         }
-#ifdef TIMING
-        times[t_dscal] += GetTime() - t0;
-#endif
-
-// update diagonal block using dgemm_
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStop(times, t_dscal, &t0);
 
+        // update diagonal block using dgemm_
+        Instr_KernelStart(&t0);
         // printf("%p\n", A);
 
         dgemm_(&TT, &NN, &ncol, &ncol, &jb, &d_m_one, T, &jb, &A[diag_pos], &jb,
                &beta, schur_buf, &ncol);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
 
         // update subdiagonal part
         const int M = nrow - nb;
         if (M > 0) {
-#ifdef TIMING
-          t0 = GetTime();
-#endif
+          Instr_KernelStart(&t0);
           dgemm_(&TT, &NN, &ncol, &M, &jb, &d_m_one, T, &jb,
                  &A[diag_pos + this_full_size], &jb, &beta,
                  &schur_buf[ncol * ncol], &ncol);
-#ifdef TIMING
-          times[t_dgemm] += GetTime() - t0;
-#endif
+          Instr_KernelStop(times, t_dgemm, &t0);
         }
 
         // beta is 0 for the first time (to avoid initializing schur_buf) and
@@ -1045,31 +981,33 @@ int DenseFact_pibh(int n, int k, int nb, double* restrict A, double* restrict B,
       }
 
 // schur_buf contains Schur complement in hybrid format (with full
-// diagonal blocks). Put it in lower-packed format in B.
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+// diagonal blocks). Put it in lower-packed format in B, or add it to B.
+      Instr_KernelStart(&t0);
       for (int buf_row = 0; buf_row < nrow; ++buf_row) {
         const int N = ncol;
-        dcopy_(&N, &schur_buf[buf_row * ncol], &i_one, &B[B_start + buf_row],
-               &nrow);
+        if (schur_beta == 0.0) {
+          dcopy_(&N, &schur_buf[buf_row * ncol], &i_one, &B[B_start + buf_row],
+                 &nrow);
+        } else {
+          daxpy_(&N, &d_one, &schur_buf[buf_row * ncol], &i_one,
+                 &B[B_start + buf_row], &nrow);
+        }
       }
       B_start += nrow * ncol;
-#ifdef TIMING
-      times[t_dcopy_schur] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dcopy_schur, &t0);
     }
 
-    free(schur_buf);
+    Mem_Free(schur_buf);
   }
 
-  free(T);
-  free(diag_start);
+  Mem_Free(T);
+  Mem_Free(diag_start);
 
   return ret_ok;
 }
 
 int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
+                     double schur_beta, const DenseFact_piv* piv,
                      double* times) {
   // ===========================================================================
   // Positive definite factorization with blocks in lower-blocked-hybrid
@@ -1078,6 +1016,8 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
   // BLAS calls: dsyrk_, dgemm_, dtrsm_, dcopy_
   // ===========================================================================
 
+  instr_start t0;
+
   // check input
   if (n < 0 || k < 0 || !A || (k < n && !B)) {
     printf("\nDenseFact_pdbh: invalid input\n");
@@ -1091,7 +1031,7 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
   const int n_blocks = (k - 1) / nb + 1;
 
   // start of diagonal blocks
-  int* diag_start = malloc(n_blocks * sizeof(double));
+  int* diag_start = Mem_Malloc(mem_dense, n_blocks * sizeof(double));
   if (!diag_start) {
     printf("\nDenseFact_pdbh: out of memory\n");
     return ret_out_of_memory;
@@ -1110,8 +1050,9 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
   int info;
 
   // buffer for full-format diagonal blocks
-  double* D = malloc(nb * nb * sizeof(double));
+  double* D = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
   if (!D) {
+    Mem_Free(diag_start);
     printf("\nDenseFact_pdbh: out of memory\n");
     return ret_out_of_memory;
   }
@@ -1125,19 +1066,15 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
     const int this_diag_size = jb * (jb + 1) / 2;
     const int this_full_size = nb * jb;
 
-// full copy of diagonal block by rows, in D
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // full copy of diagonal block by rows, in D
+    Instr_KernelStart(&t0);
     int offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &A[diag_start[j] + offset], &i_one, &D[Drow * jb], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
 
     // number of rows left below block j
     const int M = n - nb * j - jb;
@@ -1152,64 +1089,48 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
       if (j > k + 1) Pk_pos += full_size * (j - k - 1);
       const double* Pk = &A[Pk_pos];
 
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStart(&t0);
       dsyrk_(&UU, &TT, &jb, &nb, &d_m_one, Pk, &nb, &d_one, D, &jb);
-#ifdef TIMING
-      times[t_dsyrk] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dsyrk, &t0);
 
       if (M > 0) {
         const int Qk_pos = Pk_pos + this_full_size;
         const double* Qk = &A[Qk_pos];
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dgemm_(&TT, &NN, &jb, &M, &nb, &d_m_one, Pk, &nb, Qk, &nb, &d_one, R,
                &jb);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
       }
     }
 
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    int info = DenseFact_fduf('U', jb, D, jb);
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
-    if (info != 0) return info;
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fduf('U', jb, D, jb, piv, j * nb);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(D);
+      Mem_Free(diag_start);
+      return info;
+    }
 
     if (M > 0) {
-// solve block of columns with diagonal block
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // solve block of columns with diagonal block
+      Instr_KernelStart(&t0);
       dtrsm_(&LL, &UU, &TT, &NN, &jb, &M, &d_one, D, &jb, R, &jb);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dtrsm, &t0);
     }
 
-// put D back into packed format
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // put D back into packed format
+    Instr_KernelStart(&t0);
     offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &D[Drow * jb], &i_one, &A[diag_start[j] + offset], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
   }
-  free(D);
+  Mem_Free(D);
 
   // compute Schur complement if partial factorization is required
   if (k < n) {
@@ -1240,7 +1161,7 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
       // number of columns of the block
       const int ncol = min(nb, nrow);
 
-      beta = 0.0;
+      beta = schur_beta;
 
       // each block receives contributions from the blocks of the leading part
       // of A
@@ -1256,32 +1177,24 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
         }
         diag_pos += sb * this_full_size;
 
-// update diagonal block
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        // update diagonal block
+        Instr_KernelStart(&t0);
         dsyrk_(&UU, &TT, &ncol, &jb, &d_m_one, &A[diag_pos], &jb, &beta,
                schur_buf, &ncol);
-#ifdef TIMING
-        times[t_dsyrk] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dsyrk, &t0);
 
         // update subdiagonal part
         const int M = nrow - nb;
         if (M > 0) {
-#ifdef TIMING
-          t0 = GetTime();
-#endif
+          Instr_KernelStart(&t0);
           dgemm_(&TT, &NN, &nb, &M, &jb, &d_m_one, &A[diag_pos], &jb,
                  &A[diag_pos + this_full_size], &jb, &beta,
                  &schur_buf[ncol * ncol], &ncol);
-#ifdef TIMING
-          times[t_dgemm] += GetTime() - t0;
-#endif
+          Instr_KernelStop(times, t_dgemm, &t0);
         }
 
-        // beta is 0 for the first time (to avoid initializing schur_buf) and
-        // 1 for the next calls
+        // beta is schur_beta for the first time (to avoid initializing B, if
+        // the Schur complement overwrites it) and 1 for the next calls
         beta = 1.0;
       }
 
@@ -1289,12 +1202,13 @@ int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
     }
   }
 
-  free(diag_start);
+  Mem_Free(diag_start);
 
   return ret_ok;
 }
 
 int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
+                     double schur_beta, const DenseFact_piv* piv,
                      double* times) {
   // ===========================================================================
   // Indefinite factorization with blocks in lower-blocked-hybrid format.
@@ -1303,6 +1217,8 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
   // BLAS calls: dsyrk_, dgemm_, dtrsm_, dcopy_, dscal_
   // ===========================================================================
 
+  instr_start t0;
+
   // check input
   if (n < 0 || k < 0 || !A || (k < n && !B)) {
     printf("\nDenseFact_pibh: invalid input\n");
@@ -1316,7 +1232,7 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
   const int n_blocks = (k - 1) / nb + 1;
 
   // start of diagonal blocks
-  int* diag_start = malloc(n_blocks * sizeof(double));
+  int* diag_start = Mem_Malloc(mem_dense, n_blocks * sizeof(double));
   if (!diag_start) {
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
@@ -1335,15 +1251,18 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
   int info;
 
   // buffer for full-format diagonal blocks
-  double* D = malloc(nb * nb * sizeof(double));
+  double* D = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
   if (!D) {
+    Mem_Free(diag_start);
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
   }
 
   // buffer for copy of block scaled by pivots
-  double* T = malloc(nb * nb * sizeof(double));
+  double* T = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
   if (!T) {
+    Mem_Free(D);
+    Mem_Free(diag_start);
     printf("\nDenseFact_pibh: out of memory\n");
     return ret_out_of_memory;
   }
@@ -1357,19 +1276,15 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
     const int this_diag_size = jb * (jb + 1) / 2;
     const int this_full_size = nb * jb;
 
-// full copy of diagonal block by rows, in D
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    // full copy of diagonal block by rows, in D
+    Instr_KernelStart(&t0);
     int offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &A[diag_start[j] + offset], &i_one, &D[Drow * jb], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
 
     // number of rows left below block j
     const int M = n - nb * j - jb;
@@ -1385,104 +1300,77 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
       if (j > k + 1) Pk_pos += full_size * (j - k - 1);
       const double* Pk = &A[Pk_pos];
 
-// copy block jk into temp
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // copy block jk into temp
+      Instr_KernelStart(&t0);
       dcopy_(&this_full_size, Pk, &i_one, T, &i_one);
-#ifdef TIMING
-      times[t_dcopy] += GetTime() - t0;
-#endif
-
-// scale temp by pivots
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dcopy, &t0);
+
+      // scale temp by pivots
+      Instr_KernelStart(&t0);
       int pivot_pos = diag_start[k];
       for (int col = 0; col < nb; ++col) {
         dscal_(&jb, &A[pivot_pos], &T[col], &nb);
         pivot_pos += col + 2;
       }
-#ifdef TIMING
-      times[t_dscal] += GetTime() - t0;
-#endif
-
-// update diagonal block with dgemm_
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      Instr_KernelStop(times, t_dscal, &t0);
+
+      // update diagonal block with dgemm_
+      Instr_KernelStart(&t0);
       dgemm_(&TT, &NN, &jb, &jb, &nb, &d_m_one, T, &nb, Pk, &nb, &d_one, D,
              &jb);
-#ifdef TIMING
-      times[t_dgemm] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dgemm, &t0);
 
       // update rectangular block
       if (M > 0) {
         const int Qk_pos = Pk_pos + this_full_size;
         double* Qk = &A[Qk_pos];
 
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dgemm_(&TT, &NN, &jb, &M, &nb, &d_m_one, T, &nb, Qk, &nb, &d_one, R,
                &jb);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
       }
     }
 
-// factorize diagonal block
-#ifdef TIMING
-    t0 = GetTime();
-#endif
-    int info = DenseFact_fiuf('U', jb, D, jb);
-#ifdef TIMING
-    times[t_fact] += GetTime() - t0;
-#endif
-    if (info != 0) return info;
+    // factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fiuf('U', jb, D, jb, piv, j * nb);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(T);
+      Mem_Free(D);
+      Mem_Free(diag_start);
+      return info;
+    }
 
     if (M > 0) {
-// solve block of columns with diagonal block
-#ifdef TIMING
-      t0 = GetTime();
-#endif
+      // solve block of columns with diagonal block
+      Instr_KernelStart(&t0);
       dtrsm_(&LL, &UU, &TT, &UU, &jb, &M, &d_one, D, &jb, R, &jb);
-#ifdef TIMING
-      times[t_dtrsm] += GetTime() - t0;
-#endif
-
-// scale columns by pivots
-#ifdef TIMING
-      t0 = GetTime();
-#endif
-      int pivot_pos = diag_start[j];
+      Instr_KernelStop(times, t_dtrsm, &t0);
+
+      // scale columns by pivots
+      Instr_KernelStart(&t0);
+      // pivots are taken from D, since A still holds the diagonal block
+      // before the factorization
       for (int col = 0; col < jb; ++col) {
-        double coeff = 1.0 / A[pivot_pos];
+        const double coeff = 1.0 / D[col + col * jb];
         dscal_(&M, &coeff, &A[R_pos + col], &jb);
-        pivot_pos += col + 2;
       }
-#ifdef TIMING
-      times[t_dscal] += GetTime() - t0;
-#endif
+      Instr_KernelStop(times, t_dscal, &t0);
     }
 
     // put D back into packed format
-#ifdef TIMING
-    t0 = GetTime();
-#endif
+    Instr_KernelStart(&t0);
     offset = 0;
     for (int Drow = 0; Drow < jb; ++Drow) {
       const int N = Drow + 1;
       dcopy_(&N, &D[Drow * jb], &i_one, &A[diag_start[j] + offset], &i_one);
       offset += N;
     }
-#ifdef TIMING
-    times[t_dcopy] += GetTime() - t0;
-#endif
+    Instr_KernelStop(times, t_dcopy, &t0);
   }
-  free(D);
+  Mem_Free(D);
 
   // compute Schur complement if partial factorization is required
   if (k < n) {
@@ -1513,7 +1401,7 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
       // number of columns of the block
       const int ncol = min(nb, nrow);
 
-      beta = 0.0;
+      beta = schur_beta;
 
       // each block receives contributions from the blocks of the leading part
       // of A
@@ -1531,59 +1419,43 @@ int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
 
         // create copy of block, multiplied by pivots
         const int N = ncol * jb;
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         dcopy_(&N, &A[diag_pos], &i_one, T, &i_one);
-#ifdef TIMING
-        times[t_dcopy] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dcopy, &t0);
         int pivot_pos = diag_start[j];
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStart(&t0);
         for (int col = 0; col < jb; ++col) {
           dscal_(&ncol, &A[pivot_pos], &T[col], &jb);
           pivot_pos += col + 2;
         }
-#ifdef TIMING
-        times[t_dscal] += GetTime() - t0;
-#endif
-
-// update diagonal block using dgemm_
-#ifdef TIMING
-        t0 = GetTime();
-#endif
+        Instr_KernelStop(times, t_dscal, &t0);
+
+        // update diagonal block using dgemm_
+        Instr_KernelStart(&t0);
         dgemm_(&TT, &NN, &ncol, &ncol, &jb, &d_m_one, T, &jb, &A[diag_pos], &jb,
                &beta, schur_buf, &ncol);
-#ifdef TIMING
-        times[t_dgemm] += GetTime() - t0;
-#endif
+        Instr_KernelStop(times, t_dgemm, &t0);
 
         // update subdiagonal part
         const int M = nrow - nb;
         if (M > 0) {
-#ifdef TIMING
-          t0 = GetTime();
-#endif
+          Instr_KernelStart(&t0);
           dgemm_(&TT, &NN, &ncol, &M, &jb, &d_m_one, T, &jb,
                  &A[diag_pos + this_full_size], &jb, &beta,
                  &schur_buf[ncol * ncol], &ncol);
-#ifdef TIMING
-          times[t_dgemm] += GetTime() - t0;
-#endif
+          Instr_KernelStop(times, t_dgemm, &t0);
         }
 
-        // beta is 0 for the first time (to avoid initializing schur_buf) and
-        // 1 for the next calls
+        // beta is schur_beta for the first time (to avoid initializing B, if
+        // the Schur complement overwrites it) and 1 for the next calls
         beta = 1.0;
       }
       B_start += nrow * ncol;
     }
   }
 
-  free(T);
-  free(diag_start);
+  Mem_Free(T);
+  Mem_Free(diag_start);
 
   return ret_ok;
 }
@@ -1597,11 +1469,10 @@ int DenseFact_l2h(double* restrict A, int nrow, int ncol, int nb,
   // BLAS calls: dcopy_
   // ===========================================================================
 
-#ifdef TIMING
-  t0 = GetTime();
-#endif
+  instr_start t0;
 
-  double* buf = malloc(nrow * nb * sizeof(double));
+  Instr_KernelStart(&t0);
+  double* buf = Mem_Malloc(mem_dense, nrow * nb * sizeof(double));
   if (!buf) {
     printf("\nDenseFact_l2h: out of memory\n");
     return ret_out_of_memory;
@@ -1641,11 +1512,913 @@ int DenseFact_l2h(double* restrict A, int nrow, int ncol, int nb,
     }
   }
 
-  free(buf);
+  Mem_Free(buf);
+  Instr_KernelStop(times, t_convert, &t0);
+
+  return ret_ok;
+}
+
+// ===========================================================================
+// Parallel kernels.
+// The same operations of the serial kernels are split into tiles, which are
+// executed by the threads of par. The BLAS called by the tiles is assumed to
+// be single-threaded.
+// - Block column updates (dgemm_ and dtrsm_ below the diagonal block) are
+//   split into tiles of rows (full format) or of columns (hybrid format).
+// - The Schur complement is split into block columns.
+// The diagonal blocks are factorized serially, by the calling thread.
+// Times of parallel regions are measured by the calling thread: updates of
+// block columns are counted in t_dgemm and Schur complements in t_dsyrk.
+// ===========================================================================
+
+// Start of tile i, when m is split into tiles of (almost) equal size
+static int TileStart(int m, int tiles, int i) {
+  return (int)((long)m * i / tiles);
+}
+
+// Start of tile i, when the columns of a lower triangle of size m are split
+// into tiles with (almost) the same number of entries
+static int TriTileStart(int m, int tiles, int i) {
+  if (i >= tiles) return m;
+  return (int)(m * (1.0 - sqrt(1.0 - (double)i / tiles)));
+}
+
+// Number of tiles in which to split m rows or columns, so that each tile has
+// at least min_size of them and each thread receives a few tiles
+static int NumTiles(int m, int min_size, int threads) {
+  const int tiles = min(m / max(1, min_size), 4 * threads);
+  return max(1, tiles);
+}
+
+// data of the tasks for the full format kernels
+typedef struct {
+  int indef;
+  int n, k, lda, ldb;
+  double* A;
+  double* B;
+  double schur_beta;
+  int tiles;
+
+  // block column being updated
+  int j, jb, ldt;
+  const double* T;
+
+  // terms of the Schur complement: sum of alpha[i] * X[i] * X[i]^T
+  int n_terms;
+  const double* X[2];
+  int ldx, K[2];
+  double alpha[2];
+} FullTaskData;
+
+static void FullUpdateTask(int i, void* data) {
+  // update tile i of the rows of the block column below the diagonal block
+  const FullTaskData* d = data;
+  const int M_tot = d->n - d->j - d->jb;
+  const int r0 = TileStart(M_tot, d->tiles, i);
+  const int M = TileStart(M_tot, d->tiles, i + 1) - r0;
+  if (M == 0) return;
+
+  const int lda = d->lda;
+  const int j = d->j;
+  const int N = d->jb;
+  const double* D = &d->A[j + lda * j];
+  const double* Q = &d->A[j + N + r0];
+  double* R = &d->A[j + N + r0 + lda * j];
+
+  dgemm_(&NN, &TT, &M, &N, &j, &d_m_one, Q, &lda, d->T, &d->ldt, &d_one, R,
+         &lda);
+
+  if (!d->indef) {
+    dtrsm_(&RR, &LL, &TT, &NN, &M, &N, &d_one, D, &lda, R, &lda);
+  } else {
+    dtrsm_(&RR, &LL, &TT, &UU, &M, &N, &d_one, D, &lda, R, &lda);
+    for (int col = 0; col < N; ++col) {
+      const double coeff = 1.0 / D[col + lda * col];
+      dscal_(&M, &coeff, &R[lda * col], &i_one);
+    }
+  }
+}
+
+static void FullSchurTask(int i, void* data) {
+  // compute tile i of the block columns of the Schur complement
+  const FullTaskData* d = data;
+  const int ns = d->n - d->k;
+  const int c0 = TriTileStart(ns, d->tiles, i);
+  const int nc = TriTileStart(ns, d->tiles, i + 1) - c0;
+  if (nc == 0) return;
+  const int M = ns - c0 - nc;
+
+  double* Bd = &d->B[c0 + d->ldb * c0];
+  double* Bs = &d->B[c0 + nc + d->ldb * c0];
+
+  for (int t = 0; t < d->n_terms; ++t) {
+    // first term overwrites B (or is added to it, depending on schur_beta),
+    // the next ones are added to it
+    const double* beta = t == 0 ? &d->schur_beta : &d_one;
+    dsyrk_(&LL, &NN, &nc, &d->K[t], &d->alpha[t], &d->X[t][c0], &d->ldx, beta,
+           Bd, &d->ldb);
+    if (M > 0) {
+      dgemm_(&NN, &TT, &M, &nc, &d->K[t], &d->alpha[t], &d->X[t][c0 + nc],
+             &d->ldx, &d->X[t][c0], &d->ldx, beta, Bs, &d->ldb);
+    }
+  }
+}
+
+static int DenseFact_pbf_par(int indef, int n, int k, int nb,
+                             double* restrict A, int lda, double* restrict B,
+                             int ldb, double schur_beta,
+                             const DenseFact_piv* piv, double* times,
+                             const DenseFact_par* par) {
+  // ===========================================================================
+  // Parallel version of DenseFact_pdbf (indef = 0) or DenseFact_pibf
+  // (indef = 1).
+  // ===========================================================================
+
+  instr_start t0;
+
+  const char* name = indef ? "DenseFact_pibf_par" : "DenseFact_pdbf_par";
+
+  // check input
+  if (n < 0 || k < 0 || !A || lda < n || (k < n && (!B || ldb < n - k)) ||
+      !times || !par || !par->run) {
+    printf("\n%s: invalid input\n", name);
+    return ret_invalid_input;
+  }
+
+  // quick return
+  if (n == 0) return ret_ok;
+
+  FullTaskData data;
+  data.indef = indef;
+  data.n = n;
+  data.k = k;
+  data.lda = lda;
+  data.ldb = ldb;
+  data.A = A;
+  data.B = B;
+  data.schur_beta = schur_beta;
+
+  // temporary copy of block of rows, multiplied by pivots
+  double* T = NULL;
+  if (indef) {
+    T = Mem_Malloc(mem_dense, max(1, k * nb) * sizeof(double));
+    if (!T) {
+      printf("\n%s: out of memory\n", name);
+      return ret_out_of_memory;
+    }
+  }
+
+  // j is the starting col of the block of columns
+  for (int j = 0; j < k; j += nb) {
+    // jb is the size of the block
+    const int jb = min(nb, k - j);
+    const int M = n - j - jb;
+
+    double* D = &A[j + lda * j];
+    const double* P = &A[j];
+
+    // update and factorize diagonal block
+    Instr_KernelStart(&t0);
+    int info;
+    if (!indef) {
+      dsyrk_(&LL, &NN, &jb, &j, &d_m_one, P, &lda, &d_one, D, &lda);
+      info = DenseFact_fduf('L', jb, D, lda, piv, j);
+      data.T = P;
+      data.ldt = lda;
+    } else {
+      for (int i = 0; i < j; ++i) {
+        dcopy_(&jb, &A[j + i * lda], &i_one, &T[i * jb], &i_one);
+        dscal_(&jb, &A[i + i * lda], &T[i * jb], &i_one);
+      }
+      dgemm_(&NN, &TT, &jb, &jb, &j, &d_m_one, P, &lda, T, &jb, &d_one, D,
+             &lda);
+      info = DenseFact_fiuf('L', jb, D, lda, piv, j);
+      data.T = T;
+      data.ldt = jb;
+    }
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(T);
+      return info;
+    }
+
+    // update block of columns, in parallel
+    if (M > 0) {
+      Instr_KernelStart(&t0);
+      data.j = j;
+      data.jb = jb;
+      data.tiles = NumTiles(M, nb, par->threads);
+      par->run(par->pool, data.tiles, FullUpdateTask, &data);
+      Instr_KernelStop(times, t_dgemm, &t0);
+    }
+  }
+  Mem_Free(T);
+
+  // update Schur complement, in parallel
+  if (k < n) {
+    const int ns = n - k;
+    double* temp_pos = NULL;
+    double* temp_neg = NULL;
+
+    if (!indef) {
+      data.n_terms = 1;
+      data.X[0] = &A[k];
+      data.ldx = lda;
+      data.K[0] = k;
+      data.alpha[0] = -1.0;
+    } else {
+      // make temporary copies of positive and negative columns separately,
+      // multiplied by sqrt(|Ajj|), as in DenseFact_pibf
+      int pos_pivot = 0;
+      for (int i = 0; i < k; ++i) {
+        if (A[i + lda * i] >= 0.0) ++pos_pivot;
+      }
+      const int neg_pivot = k - pos_pivot;
+
+      temp_pos = Mem_Malloc(mem_dense, ns * max(1, pos_pivot) * sizeof(double));
+      temp_neg = Mem_Malloc(mem_dense, ns * max(1, neg_pivot) * sizeof(double));
+      if (!temp_pos || !temp_neg) {
+        printf("\n%s: out of memory\n", name);
+        Mem_Free(temp_pos);
+        Mem_Free(temp_neg);
+        return ret_out_of_memory;
+      }
+
+      int start_pos = 0;
+      int start_neg = 0;
+      for (int j = 0; j < k; ++j) {
+        const double Ajj = A[j + lda * j];
+        double* col = Ajj >= 0.0 ? &temp_pos[ns * start_pos++]
+                                 : &temp_neg[ns * start_neg++];
+        const double coeff = sqrt(fabs(Ajj));
+        dcopy_(&ns, &A[k + j * lda], &i_one, col, &i_one);
+        dscal_(&ns, &coeff, col, &i_one);
+      }
+
+      data.n_terms = 2;
+      data.X[0] = temp_pos;
+      data.X[1] = temp_neg;
+      data.ldx = ns;
+      data.K[0] = pos_pivot;
+      data.K[1] = neg_pivot;
+      data.alpha[0] = -1.0;
+      data.alpha[1] = 1.0;
+    }
+
+    Instr_KernelStart(&t0);
+    data.tiles = NumTiles(ns, nb, par->threads);
+    par->run(par->pool, data.tiles, FullSchurTask, &data);
+    Instr_KernelStop(times, t_dsyrk, &t0);
+
+    Mem_Free(temp_pos);
+    Mem_Free(temp_neg);
+  }
+
+  return ret_ok;
+}
+
+int DenseFact_pdbf_par(int n, int k, int nb, double* restrict A, int lda,
+                       double* restrict B, int ldb, double schur_beta,
+                       const DenseFact_piv* piv, double* times,
+                       const DenseFact_par* par) {
+  return DenseFact_pbf_par(0, n, k, nb, A, lda, B, ldb, schur_beta, piv,
+                           times, par);
+}
+
+int DenseFact_pibf_par(int n, int k, int nb, double* restrict A, int lda,
+                       double* restrict B, int ldb, double schur_beta,
+                       const DenseFact_piv* piv, double* times,
+                       const DenseFact_par* par) {
+  return DenseFact_pbf_par(1, n, k, nb, A, lda, B, ldb, schur_beta, piv,
+                           times, par);
+}
+
+// data of the tasks for the blocked-hybrid format kernels
+typedef struct {
+  int indef;
+  int n, k, nb, n_blocks;
+  double* A;
+  double* B;
+  double schur_beta;
+  const int* diag_start;
+  int tiles;
+
+  // block column being updated
+  int j, jb;
+  const double* D;
+  const double* T;
+
+  // status of each task of the Schur complement
+  int* status;
+} HybTaskData;
+
+static void HybUpdateTask(int i, void* data) {
+  // update tile i of the columns of block R below diagonal block j
+  const HybTaskData* d = data;
+  const int nb = d->nb;
+  const int j = d->j;
+  const int jb = d->jb;
+  const int M_tot = d->n - nb * j - jb;
+  const int m0 = TileStart(M_tot, d->tiles, i);
+  const int M = TileStart(M_tot, d->tiles, i + 1) - m0;
+  if (M == 0) return;
+
+  const int this_diag_size = jb * (jb + 1) / 2;
+  const int this_full_size = nb * jb;
+  const int diag_size = nb * (nb + 1) / 2;
+  const int full_size = nb * nb;
+
+  double* R = &d->A[d->diag_start[j] + this_diag_size + jb * m0];
+
+  for (int k = 0; k < j; ++k) {
+    int Pk_pos = d->diag_start[k] + diag_size;
+    if (j > k + 1) Pk_pos += full_size * (j - k - 1);
+    const double* Qk = &d->A[Pk_pos + this_full_size + nb * m0];
+
+    // for indefinite, T contains the blocks Pk multiplied by the pivots
+    const double* Pk = d->indef ? &d->T[k * full_size] : &d->A[Pk_pos];
+
+    dgemm_(&TT, &NN, &jb, &M, &nb, &d_m_one, Pk, &nb, Qk, &nb, &d_one, R, &jb);
+  }
+
+  if (!d->indef) {
+    dtrsm_(&LL, &UU, &TT, &NN, &jb, &M, &d_one, d->D, &jb, R, &jb);
+  } else {
+    dtrsm_(&LL, &UU, &TT, &UU, &jb, &M, &d_one, d->D, &jb, R, &jb);
+    for (int col = 0; col < jb; ++col) {
+      const double coeff = 1.0 / d->D[col + col * jb];
+      dscal_(&M, &coeff, &R[col], &jb);
+    }
+  }
+}
+
+static void HybSchurTask(int sb, void* data) {
+  // compute block column sb of the Schur complement, as in DenseFact_pdbh and
+  // DenseFact_pibh
+  const HybTaskData* d = data;
+  const int nb = d->nb;
+  const int k = d->k;
+  const int n_blocks = d->n_blocks;
+  const double* A = d->A;
+
+  const int ns = d->n - k;
+  const int nrow = ns - nb * sb;
+  const int ncol = min(nb, nrow);
+  const int full_size = nb * nb;
+  const int ncol_last = k % nb;
+  const int last_full_size = ncol_last == 0 ? full_size : ncol_last * nb;
+
+  // start of block sb in B
+  int B_start = 0;
+  for (int s = 0; s < sb; ++s) B_start += (ns - nb * s) * nb;
+
+  double* schur_buf = Mem_Malloc(mem_dense, nrow * ncol * sizeof(double));
+  double* T =
+      d->indef ? Mem_Malloc(mem_dense, full_size * sizeof(double)) : NULL;
+  if (!schur_buf || (d->indef && !T)) {
+    Mem_Free(schur_buf);
+    Mem_Free(T);
+    d->status[sb] = ret_out_of_memory;
+    return;
+  }
+
+  double beta = 0.0;
+  for (int j = 0; j < n_blocks; ++j) {
+    const int jb = min(nb, k - nb * j);
+    const int this_diag_size = jb * (jb + 1) / 2;
+    const int this_full_size = nb * jb;
+
+    int diag_pos = d->diag_start[j] + this_diag_size;
+    if (j < n_blocks - 1) {
+      diag_pos += (n_blocks - j - 2) * full_size + last_full_size;
+    }
+    diag_pos += sb * this_full_size;
+
+    const int M = nrow - nb;
+
+    if (!d->indef) {
+      dsyrk_(&UU, &TT, &ncol, &jb, &d_m_one, &A[diag_pos], &jb, &beta,
+             schur_buf, &ncol);
+      if (M > 0) {
+        dgemm_(&TT, &NN, &nb, &M, &jb, &d_m_one, &A[diag_pos], &jb,
+               &A[diag_pos + this_full_size], &jb, &beta,
+               &schur_buf[ncol * ncol], &ncol);
+      }
+    } else {
+      // copy of block, multiplied by pivots
+      const int N = ncol * jb;
+      dcopy_(&N, &A[diag_pos], &i_one, T, &i_one);
+      int pivot_pos = d->diag_start[j];
+      for (int col = 0; col < jb; ++col) {
+        dscal_(&ncol, &A[pivot_pos], &T[col], &jb);
+        pivot_pos += col + 2;
+      }
+
+      dgemm_(&TT, &NN, &ncol, &ncol, &jb, &d_m_one, T, &jb, &A[diag_pos], &jb,
+             &beta, schur_buf, &ncol);
+      if (M > 0) {
+        dgemm_(&TT, &NN, &ncol, &M, &jb, &d_m_one, T, &jb,
+               &A[diag_pos + this_full_size], &jb, &beta,
+               &schur_buf[ncol * ncol], &ncol);
+      }
+    }
+    beta = 1.0;
+  }
+
+  // put block in lower-packed format in B, or add it to B
+  for (int buf_row = 0; buf_row < nrow; ++buf_row) {
+    if (d->schur_beta == 0.0) {
+      dcopy_(&ncol, &schur_buf[buf_row * ncol], &i_one,
+             &d->B[B_start + buf_row], &nrow);
+    } else {
+      daxpy_(&ncol, &d_one, &schur_buf[buf_row * ncol], &i_one,
+             &d->B[B_start + buf_row], &nrow);
+    }
+  }
+
+  Mem_Free(schur_buf);
+  Mem_Free(T);
+}
+
+static int DenseFact_pbh_par(int indef, int n, int k, int nb,
+                             double* restrict A, double* restrict B,
+                             double schur_beta, const DenseFact_piv* piv,
+                             double* times, const DenseFact_par* par) {
+  // ===========================================================================
+  // Parallel version of DenseFact_pdbh (indef = 0) or DenseFact_pibh
+  // (indef = 1).
+  // ===========================================================================
+
+  instr_start t0;
+
+  const char* name = indef ? "DenseFact_pibh_par" : "DenseFact_pdbh_par";
+
+  // check input
+  if (n < 0 || k < 0 || !A || (k < n && !B) || !times || !par || !par->run) {
+    printf("\n%s: invalid input\n", name);
+    return ret_invalid_input;
+  }
+
+  // quick return
+  if (n == 0) return ret_ok;
+
+  // number of blocks of columns
+  const int n_blocks = (k - 1) / nb + 1;
+
+  // start of diagonal blocks
+  int* diag_start = Mem_Malloc(mem_dense, n_blocks * sizeof(int));
+
+  // buffer for full-format diagonal blocks
+  double* D = Mem_Malloc(mem_dense, nb * nb * sizeof(double));
+
+  // for indefinite, buffer for the blocks of a block row, scaled by pivots
+  double* T = indef ? Mem_Malloc(mem_dense, n_blocks * nb * nb * sizeof(double))
+                    : NULL;
+
+  if (!diag_start || !D || (indef && !T)) {
+    printf("\n%s: out of memory\n", name);
+    Mem_Free(diag_start);
+    Mem_Free(D);
+    Mem_Free(T);
+    return ret_out_of_memory;
+  }
+
+  diag_start[0] = 0;
+  for (int i = 1; i < n_blocks; ++i) {
+    diag_start[i] =
+        diag_start[i - 1] + nb * (2 * n - 2 * (i - 1) * nb - nb + 1) / 2;
+  }
+
+  // size of blocks
+  const int diag_size = nb * (nb + 1) / 2;
+  const int full_size = nb * nb;
+
+  HybTaskData data;
+  data.indef = indef;
+  data.n = n;
+  data.k = k;
+  data.nb = nb;
+  data.n_blocks = n_blocks;
+  data.A = A;
+  data.B = B;
+  data.schur_beta = schur_beta;
+  data.diag_start = diag_start;
+  data.D = D;
+  data.T = T;
+
+  int status = ret_ok;
+
+  // j is the index of the block column
+  for (int j = 0; j < n_blocks; ++j) {
+    // jb is the number of columns
+    const int jb = min(nb, k - nb * j);
+    const int this_full_size = nb * jb;
+
+    // number of rows left below block j
+    const int M = n - nb * j - jb;
+
+    Instr_KernelStart(&t0);
+    // full copy of diagonal block by rows, in D
+    int offset = 0;
+    for (int Drow = 0; Drow < jb; ++Drow) {
+      const int N = Drow + 1;
+      dcopy_(&N, &A[diag_start[j] + offset], &i_one, &D[Drow * jb], &i_one);
+      offset += N;
+    }
+
+    // update and factorize diagonal block
+    for (int k = 0; k < j; ++k) {
+      int Pk_pos = diag_start[k] + diag_size;
+      if (j > k + 1) Pk_pos += full_size * (j - k - 1);
+      const double* Pk = &A[Pk_pos];
+
+      if (!indef) {
+        dsyrk_(&UU, &TT, &jb, &nb, &d_m_one, Pk, &nb, &d_one, D, &jb);
+      } else {
+        double* Tk = &T[k * full_size];
+        dcopy_(&this_full_size, Pk, &i_one, Tk, &i_one);
+        int pivot_pos = diag_start[k];
+        for (int col = 0; col < nb; ++col) {
+          dscal_(&jb, &A[pivot_pos], &Tk[col], &nb);
+          pivot_pos += col + 2;
+        }
+        dgemm_(&TT, &NN, &jb, &jb, &nb, &d_m_one, Tk, &nb, Pk, &nb, &d_one, D,
+               &jb);
+      }
+    }
+    const int info = indef ? DenseFact_fiuf('U', jb, D, jb, piv, j * nb)
+                           : DenseFact_fduf('U', jb, D, jb, piv, j * nb);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      status = info;
+      break;
+    }
+
+    // update block of columns, in parallel
+    if (M > 0) {
+      Instr_KernelStart(&t0);
+      data.j = j;
+      data.jb = jb;
+      data.tiles = NumTiles(M, nb, par->threads);
+      par->run(par->pool, data.tiles, HybUpdateTask, &data);
+      Instr_KernelStop(times, t_dgemm, &t0);
+    }
+
+    // put D back into packed format
+    offset = 0;
+    for (int Drow = 0; Drow < jb; ++Drow) {
+      const int N = Drow + 1;
+      dcopy_(&N, &D[Drow * jb], &i_one, &A[diag_start[j] + offset], &i_one);
+      offset += N;
+    }
+  }
+  Mem_Free(D);
+  Mem_Free(T);
+
+  // compute Schur complement, in parallel over its block columns
+  if (status == ret_ok && k < n) {
+    const int s_blocks = (n - k - 1) / nb + 1;
+    data.status = Mem_Calloc(mem_dense, s_blocks, sizeof(int));
+    if (!data.status) {
+      printf("\n%s: out of memory\n", name);
+      Mem_Free(diag_start);
+      return ret_out_of_memory;
+    }
+
+    Instr_KernelStart(&t0);
+    par->run(par->pool, s_blocks, HybSchurTask, &data);
+    Instr_KernelStop(times, t_dsyrk, &t0);
+
+    for (int sb = 0; sb < s_blocks; ++sb) {
+      if (data.status[sb]) {
+        printf("\n%s: out of memory\n", name);
+        status = data.status[sb];
+        break;
+      }
+    }
+    Mem_Free(data.status);
+  }
+
+  Mem_Free(diag_start);
+
+  return status;
+}
+
+int DenseFact_pdbh_par(int n, int k, int nb, double* restrict A,
+                       double* restrict B, double schur_beta,
+                       const DenseFact_piv* piv, double* times,
+                       const DenseFact_par* par) {
+  return DenseFact_pbh_par(0, n, k, nb, A, B, schur_beta, piv, times, par);
+}
+
+int DenseFact_pibh_par(int n, int k, int nb, double* restrict A,
+                       double* restrict B, double schur_beta,
+                       const DenseFact_piv* piv, double* times,
+                       const DenseFact_par* par) {
+  return DenseFact_pbh_par(1, n, k, nb, A, B, schur_beta, piv, times, par);
+}
+
+// ===========================================================================
+// Single precision versions of the unblocked and full format kernels, used
+// for mixed precision factorisations. The arguments are the same as for the
+// double precision versions; schur_beta and the static pivoting data are kept
+// in double precision.
+// ===========================================================================
+
+// Dot product of single precision vectors, accumulated in double precision.
+// sdot_ is not used, because its return type differs between BLAS libraries.
+static double DotSingle(int n, const float* x, int incx, const float* y,
+                        int incy) {
+  double sum = 0.0;
+  for (int i = 0; i < n; ++i) sum += (double)x[i * incx] * y[i * incy];
+  return sum;
+}
+
+int DenseFact_fduf_s(int n, float* restrict A, int lda,
+                     const DenseFact_piv* piv, int offset) {
+  // ===========================================================================
+  // Positive definite factorization without blocks, lower triangle.
+  // BLAS calls: sgemv_, sscal_.
+  // ===========================================================================
+
+  // check input
+  if (n < 0 || !A || lda < n) {
+    printf("\nDenseFact_fduf_s: invalid input\n");
+    return ret_invalid_input;
+  }
+
+  for (int j = 0; j < n; ++j) {
+    const int N = j;
+    const int M = n - j - 1;
+
+    // update diagonal element
+    double Ajj = A[j + lda * j] - DotSingle(N, &A[j], lda, &A[j], lda);
+    if (StaticPivot(0, &Ajj, piv, offset + j)) {
+      A[j + lda * j] = Ajj;
+      printf("\nDenseFact_fduf_s: invalid pivot\n");
+      return ret_invalid_pivot;
+    }
+
+    // compute diagonal element
+    Ajj = sqrt(Ajj);
+    A[j + lda * j] = Ajj;
+    const float coeff = 1.0 / Ajj;
+
+    // compute column j
+    if (j < n - 1) {
+      sgemv_(&NN, &M, &N, &s_m_one, &A[j + 1], &lda, &A[j], &lda, &s_one,
+             &A[j + 1 + j * lda], &i_one);
+      sscal_(&M, &coeff, &A[j + 1 + j * lda], &i_one);
+    }
+  }
+
+  return ret_ok;
+}
+
+int DenseFact_fiuf_s(int n, float* restrict A, int lda,
+                     const DenseFact_piv* piv, int offset) {
+  // ===========================================================================
+  // Indefinite factorization without blocks, lower triangle.
+  // BLAS calls: sgemv_, sscal_.
+  // ===========================================================================
 
-#ifdef TIMING
-  times[t_convert] += GetTime() - t0;
-#endif
+  // check input
+  if (n < 0 || !A || lda < n) {
+    printf("\nDenseFact_fiuf_s: invalid input\n");
+    return ret_invalid_input;
+  }
+
+  // quick return
+  if (n == 0) return ret_ok;
+
+  // allocate space for copy of row multiplied by pivots
+  float* temp = Mem_Malloc(mem_dense, n * sizeof(float));
+  if (!temp) {
+    printf("\nDenseFact_fiuf_s: out of memory\n");
+    return ret_out_of_memory;
+  }
+
+  for (int j = 0; j < n; ++j) {
+    const int N = j;
+    const int M = n - j - 1;
+
+    // create temporary copy of row j, multiplied by pivots
+    for (int i = 0; i < j; ++i) temp[i] = A[j + i * lda] * A[i + i * lda];
+
+    // update diagonal element
+    double Ajj = A[j + lda * j] - DotSingle(N, &A[j], lda, temp, 1);
+    if (StaticPivot(1, &Ajj, piv, offset + j)) {
+      A[j + lda * j] = Ajj;
+      Mem_Free(temp);
+      printf("\nDenseFact_fiuf_s: invalid pivot\n");
+      return ret_invalid_pivot;
+    }
+
+    // save diagonal element
+    A[j + lda * j] = Ajj;
+    const float coeff = 1.0 / Ajj;
+
+    // compute column j
+    if (j < n - 1) {
+      sgemv_(&NN, &M, &N, &s_m_one, &A[j + 1], &lda, temp, &i_one, &s_one,
+             &A[j + 1 + j * lda], &i_one);
+      sscal_(&M, &coeff, &A[j + 1 + j * lda], &i_one);
+    }
+  }
+
+  Mem_Free(temp);
+
+  return ret_ok;
+}
+
+int DenseFact_pdbf_s(int n, int k, int nb, float* restrict A, int lda,
+                     float* restrict B, int ldb, double schur_beta,
+                     const DenseFact_piv* piv, double* times) {
+  // ===========================================================================
+  // Positive definite factorization with blocks, single precision.
+  // BLAS calls: ssyrk_, sgemm_, strsm_.
+  // ===========================================================================
+
+  instr_start t0;
+
+  // check input
+  if (n < 0 || k < 0 || !A || lda < n || (k < n && (!B || ldb < n - k)) ||
+      !times) {
+    printf("\nDenseFact_pdbf_s: invalid input\n");
+    return ret_invalid_input;
+  }
+
+  // quick return
+  if (n == 0) return ret_ok;
+
+  // j is the starting col of the block of columns
+  for (int j = 0; j < k; j += nb) {
+    // jb is the size of the block
+    const int jb = min(nb, k - j);
+
+    // sizes for blas calls
+    const int N = jb;
+    const int K = j;
+    const int M = n - j - jb;
+
+    // starting position of matrices for BLAS calls
+    float* D = &A[j + lda * j];
+    const float* P = &A[j];
+    const float* Q = &A[j + N];
+    float* R = &A[j + N + lda * j];
+
+    // update and factorize diagonal block
+    Instr_KernelStart(&t0);
+    ssyrk_(&LL, &NN, &N, &K, &s_m_one, P, &lda, &s_one, D, &lda);
+    Instr_KernelStop(times, t_dsyrk, &t0);
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fduf_s(N, D, lda, piv, j);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) return info;
+
+    if (j + jb < n) {
+      // update block of columns and solve with diagonal block
+      Instr_KernelStart(&t0);
+      sgemm_(&NN, &TT, &M, &N, &K, &s_m_one, Q, &lda, P, &lda, &s_one, R, &lda);
+      Instr_KernelStop(times, t_dgemm, &t0);
+      Instr_KernelStart(&t0);
+      strsm_(&RR, &LL, &TT, &NN, &M, &N, &s_one, D, &lda, R, &lda);
+      Instr_KernelStop(times, t_dtrsm, &t0);
+    }
+  }
+
+  // update Schur complement if partial factorization is required
+  if (k < n) {
+    const int N = n - k;
+    const float beta = schur_beta;
+    Instr_KernelStart(&t0);
+    ssyrk_(&LL, &NN, &N, &k, &s_m_one, &A[k], &lda, &beta, B, &ldb);
+    Instr_KernelStop(times, t_dsyrk, &t0);
+  }
+
+  return ret_ok;
+}
+
+int DenseFact_pibf_s(int n, int k, int nb, float* restrict A, int lda,
+                     float* restrict B, int ldb, double schur_beta,
+                     const DenseFact_piv* piv, double* times) {
+  // ===========================================================================
+  // Indefinite factorization with blocks, single precision.
+  // BLAS calls: scopy_, sscal_, sgemm_, strsm_, ssyrk_
+  // ===========================================================================
+
+  instr_start t0;
+
+  // check input
+  if (n < 0 || k < 0 || !A || lda < n || (k < n && (!B || ldb < n - k))) {
+    printf("\nDenseFact_pibf_s: invalid input\n");
+    return ret_invalid_input;
+  }
+
+  // quick return
+  if (n == 0) return ret_ok;
+
+  // temporary copy of block of rows, multiplied by pivots
+  float* T = Mem_Malloc(mem_dense, (size_t)k * nb * sizeof(float));
+  if (!T) {
+    printf("\nDenseFact_pibf_s: out of memory\n");
+    return ret_out_of_memory;
+  }
+
+  // j is the starting col of the block of columns
+  for (int j = 0; j < k; j += nb) {
+    // jb is the size of the block
+    const int jb = min(nb, k - j);
+
+    // sizes for blas calls
+    const int N = jb;
+    const int K = j;
+    const int M = n - j - jb;
+
+    // starting position of matrices for BLAS calls
+    float* D = &A[j + lda * j];
+    const float* P = &A[j];
+    const float* Q = &A[j + N];
+    float* R = &A[j + N + lda * j];
+
+    const int ldt = jb;
+    for (int i = 0; i < j; ++i) {
+      scopy_(&N, &A[j + i * lda], &i_one, &T[i * ldt], &i_one);
+      sscal_(&N, &A[i + i * lda], &T[i * ldt], &i_one);
+    }
+
+    // update and factorize diagonal block
+    Instr_KernelStart(&t0);
+    sgemm_(&NN, &TT, &jb, &jb, &j, &s_m_one, P, &lda, T, &ldt, &s_one, D, &lda);
+    Instr_KernelStop(times, t_dgemm, &t0);
+    Instr_KernelStart(&t0);
+    int info = DenseFact_fiuf_s(N, D, lda, piv, j);
+    Instr_KernelStop(times, t_fact, &t0);
+    if (info != 0) {
+      Mem_Free(T);
+      return info;
+    }
+
+    if (j + jb < n) {
+      // update block of columns and solve with L and D
+      Instr_KernelStart(&t0);
+      sgemm_(&NN, &TT, &M, &N, &K, &s_m_one, Q, &lda, T, &ldt, &s_one, R, &lda);
+      Instr_KernelStop(times, t_dgemm, &t0);
+      Instr_KernelStart(&t0);
+      strsm_(&RR, &LL, &TT, &UU, &M, &N, &s_one, D, &lda, R, &lda);
+      Instr_KernelStop(times, t_dtrsm, &t0);
+      for (int i = 0; i < jb; ++i) {
+        const float coeff = 1.0 / A[j + i + (j + i) * lda];
+        sscal_(&M, &coeff, &A[j + jb + lda * (j + i)], &i_one);
+      }
+    }
+  }
+
+  Mem_Free(T);
+
+  // update Schur complement
+  if (k < n) {
+    const int N = n - k;
+    const int ldt = n - k;
+
+    // count number of positive and negative pivots
+    int pos_pivot = 0;
+    for (int i = 0; i < k; ++i) pos_pivot += A[i + lda * i] >= 0.0;
+    const int neg_pivot = k - pos_pivot;
+
+    // copies of the positive and negative columns, multiplied by sqrt(|Ajj|)
+    float* temp_pos =
+        Mem_Malloc(mem_dense, (size_t)ldt * pos_pivot * sizeof(float));
+    float* temp_neg =
+        Mem_Malloc(mem_dense, (size_t)ldt * neg_pivot * sizeof(float));
+    if ((pos_pivot && !temp_pos) || (neg_pivot && !temp_neg)) {
+      Mem_Free(temp_pos);
+      Mem_Free(temp_neg);
+      printf("\nDenseFact_pibf_s: out of memory\n");
+      return ret_out_of_memory;
+    }
+
+    int start_pos = 0;
+    int start_neg = 0;
+    for (int j = 0; j < k; ++j) {
+      const float Ajj = A[j + lda * j];
+      const float coeff = sqrt(fabs(Ajj));
+      float* col = Ajj >= 0.0 ? &temp_pos[start_pos++ * ldt]
+                              : &temp_neg[start_neg++ * ldt];
+      scopy_(&N, &A[k + j * lda], &i_one, col, &i_one);
+      sscal_(&N, &coeff, col, &i_one);
+    }
+
+    // subtract the positive columns and add the negative ones, as in pibf
+    const float beta = schur_beta;
+    Instr_KernelStart(&t0);
+    ssyrk_(&LL, &NN, &N, &pos_pivot, &s_m_one, temp_pos, &ldt, &beta, B, &ldb);
+    ssyrk_(&LL, &NN, &N, &neg_pivot, &s_one, temp_neg, &ldt, &s_one, B, &ldb);
+    Instr_KernelStop(times, t_dsyrk, &t0);
+
+    Mem_Free(temp_pos);
+    Mem_Free(temp_neg);
+  }
 
   return ret_ok;
 }
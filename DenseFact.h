@@ -1,15 +1,8 @@
 #ifndef DENSE_FACT_H
 #define DENSE_FACT_H
 
-#include <time.h>
 #include "Blas_declaration.h"
 
-double GetTime() {
-  struct timespec now;
-  clock_gettime(CLOCK_REALTIME, &now);
-  return now.tv_sec + now.tv_nsec * 1e-9;
-}
-
 #define max(i, j) ((i) >= (j) ? (i) : (j))
 #define min(i, j) ((i) >= (j) ? (j) : (i))
 
@@ -17,6 +10,8 @@ double GetTime() {
 const double d_one = 1.0;
 const double d_zero = 0.0;
 const double d_m_one = -1.0;
+const float s_one = 1.0f;
+const float s_m_one = -1.0f;
 const int i_one = 1;
 const char LL = 'L';
 const char NN = 'N';
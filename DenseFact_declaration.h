@@ -5,28 +5,93 @@
 extern "C" {
 #endif
 
+// Static pivoting.
+// A pivot is not acceptable if it is NaN, if it is <= thresh (positive
+// definite), or if |pivot| <= thresh or its sign differs from sign[j]
+// (indefinite). Such a pivot is replaced by +-delta and the factorization
+// continues; the perturbation is stored in reg[j].
+// sign may be NULL, or sign[j] may be 0, if the expected sign is unknown; in
+// this case, the sign of the pivot is kept. reg may be NULL.
+// j is the index of the column within the front.
+// If the kernels are given a NULL pointer, they stop at the first pivot that
+// is zero (indefinite) or not positive (positive definite).
+typedef struct {
+  const int* sign;
+  double* reg;
+  double thresh;
+  double delta;
+} DenseFact_piv;
+
 // dense factorization kernels
-int DenseFact_fduf(char uplo, int n, double* A, int lda);
-int DenseFact_fiuf(char uplo, int n, double* A, int lda);
+// offset is the index within the front of the first column of A
+int DenseFact_fduf(char uplo, int n, double* A, int lda,
+                   const DenseFact_piv* piv, int offset);
+int DenseFact_fiuf(char uplo, int n, double* A, int lda,
+                   const DenseFact_piv* piv, int offset);
+
+// The partial factorizations compute the Schur complement S into B:
+// B = S if schur_beta is 0, B = B + S if schur_beta is 1.
 
 // dense partial factorization, with blocks
 int DenseFact_pdbf(int n, int k, int nb, double* A, int lda, double* B, int ldb,
-                   double* times);
+                   double schur_beta, const DenseFact_piv* piv, double* times);
 int DenseFact_pibf(int n, int k, int nb, double* A, int lda, double* B, int ldb,
-                   double* times);
+                   double schur_beta, const DenseFact_piv* piv, double* times);
 
 // dense partial factorization, in blocked-hybrid format
-int DenseFact_pdbh(int n, int k, int nb, double* A, double* B, double* times);
-int DenseFact_pibh(int n, int k, int nb, double* A, double* B, double* times);
+int DenseFact_pdbh(int n, int k, int nb, double* A, double* B,
+                   double schur_beta, const DenseFact_piv* piv, double* times);
+int DenseFact_pibh(int n, int k, int nb, double* A, double* B,
+                   double schur_beta, const DenseFact_piv* piv, double* times);
 
 // dense partial factorization, in blocked-hybrid format with hybrid Schur
 // complement
-int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B, double* times);
-int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B, double* times);
+int DenseFact_pdbh_2(int n, int k, int nb, double* A, double* B,
+                     double schur_beta, const DenseFact_piv* piv,
+                     double* times);
+int DenseFact_pibh_2(int n, int k, int nb, double* A, double* B,
+                     double schur_beta, const DenseFact_piv* piv,
+                     double* times);
+
+// single precision factorizations, lower triangle in full format
+int DenseFact_fduf_s(int n, float* A, int lda, const DenseFact_piv* piv,
+                     int offset);
+int DenseFact_fiuf_s(int n, float* A, int lda, const DenseFact_piv* piv,
+                     int offset);
+int DenseFact_pdbf_s(int n, int k, int nb, float* A, int lda, float* B, int ldb,
+                     double schur_beta, const DenseFact_piv* piv,
+                     double* times);
+int DenseFact_pibf_s(int n, int k, int nb, float* A, int lda, float* B, int ldb,
+                     double schur_beta, const DenseFact_piv* piv,
+                     double* times);
 
 // function to convert A from lower packed, to lower-blocked-hybrid format
 int DenseFact_l2h(double* A, int nrow, int ncol, int nb, double* times);
 
+// Thread pool used by the parallel kernels.
+// run(pool, n, task, data) calls task(i, data) for i = 0,...,n-1, possibly in
+// parallel, and returns when all the calls are completed.
+// threads is the number of threads of the pool, used to choose the tiles.
+typedef struct {
+  void (*run)(void* pool, int n, void (*task)(int, void*), void* data);
+  void* pool;
+  int threads;
+} DenseFact_par;
+
+// dense partial factorization, with tiles executed in parallel by par
+int DenseFact_pdbf_par(int n, int k, int nb, double* A, int lda, double* B,
+                       int ldb, double schur_beta, const DenseFact_piv* piv,
+                       double* times, const DenseFact_par* par);
+int DenseFact_pibf_par(int n, int k, int nb, double* A, int lda, double* B,
+                       int ldb, double schur_beta, const DenseFact_piv* piv,
+                       double* times, const DenseFact_par* par);
+int DenseFact_pdbh_par(int n, int k, int nb, double* A, double* B,
+                       double schur_beta, const DenseFact_piv* piv,
+                       double* times, const DenseFact_par* par);
+int DenseFact_pibh_par(int n, int k, int nb, double* A, double* B,
+                       double schur_beta, const DenseFact_piv* piv,
+                       double* times, const DenseFact_par* par);
+
 #ifdef __cplusplus
 }
 #endif
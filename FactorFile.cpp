@@ -0,0 +1,153 @@
+#include "FactorFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include "DenseFact_declaration.h"
+#include "Memory.h"
+
+FactorFile::~FactorFile() { Close(); }
+
+void FactorFile::Close() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv_queue.notify_all();
+    writer.join();
+  }
+  if (map) munmap(map, map_size);
+  map = nullptr;
+  map_size = 0;
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+int FactorFile::Open(const std::string& file_name,
+                     const std::vector<size_t>& size,
+                     size_t memory_limit_input) {
+  Close();
+
+  offset.assign(size.size() + 1, 0);
+  for (int sn = 0; sn < size.size(); ++sn)
+    offset[sn + 1] = offset[sn] + size[sn];
+  queue.clear();
+  queued_bytes = 0;
+  memory_limit = memory_limit_input;
+  stop = false;
+  status = ret_ok;
+
+  std::string path = file_name;
+  if (path.empty()) {
+    const char* dir = getenv("TMPDIR");
+    path = std::string(dir && *dir ? dir : "/tmp") + "/factorXXXXXX";
+    fd = mkstemp(&path[0]);
+
+    // the name is removed now, and the file disappears when it is closed
+    if (fd >= 0) unlink(path.c_str());
+  } else {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  }
+  if (fd < 0) {
+    printf("FactorFile: cannot create %s\n", path.c_str());
+    return ret_invalid_input;
+  }
+
+  // the space of the whole factor is reserved, so that the supernodes can be
+  // written in any order
+  if (ftruncate(fd, offset.back() * sizeof(double)) != 0) {
+    printf("FactorFile: cannot resize %s\n", path.c_str());
+    Close();
+    return ret_generic;
+  }
+
+  writer = std::thread(&FactorFile::WriterLoop, this);
+  return ret_ok;
+}
+
+void FactorFile::Write(int sn, std::vector<double>& columns) {
+  const size_t bytes = columns.size() * sizeof(double);
+
+  // A supernode larger than the limit is queued once the queue is empty
+  std::unique_lock<std::mutex> lock(mutex);
+  cv_space.wait(lock, [&] {
+    return queue.empty() || queued_bytes + bytes <= memory_limit;
+  });
+  queue.emplace_back(sn, &columns);
+  queued_bytes += bytes;
+  cv_queue.notify_one();
+}
+
+void FactorFile::WriterLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv_queue.wait(lock, [&] { return stop || !queue.empty(); });
+    if (queue.empty()) return;
+
+    const int sn = queue.front().first;
+    std::vector<double>* columns = queue.front().second;
+    lock.unlock();
+
+    // pwrite may write fewer bytes than requested
+    const size_t bytes = columns->size() * sizeof(double);
+    const char* data = reinterpret_cast<const char*>(columns->data());
+    size_t done = 0;
+    bool ok = bytes <= (offset[sn + 1] - offset[sn]) * sizeof(double);
+    while (ok && done < bytes) {
+      const ssize_t written = pwrite(fd, data + done, bytes - done,
+                                     offset[sn] * sizeof(double) + done);
+      if (written < 0 && errno == EINTR) continue;
+      ok = written > 0;
+      if (ok) done += written;
+    }
+
+    const size_t freed = columns->capacity() * sizeof(double);
+    std::vector<double>().swap(*columns);
+    Mem_Add(mem_factor, -(int64_t)freed);
+
+    lock.lock();
+    if (!ok) status = ret_generic;
+    queue.pop_front();
+    queued_bytes -= bytes;
+    cv_space.notify_all();
+  }
+}
+
+int FactorFile::Finish() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv_queue.notify_all();
+    writer.join();
+  }
+  if (status) {
+    printf("FactorFile: error writing the factor\n");
+    return status;
+  }
+
+  map_size = offset.back() * sizeof(double);
+  if (map_size > 0) {
+    map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      map = nullptr;
+      printf("FactorFile: mmap failed\n");
+      return ret_generic;
+    }
+
+    // the solves go through the supernodes forward and then backward
+    madvise(map, map_size, MADV_SEQUENTIAL);
+  }
+  return ret_ok;
+}
+
+const double* FactorFile::Columns(int sn) const {
+  return static_cast<const double*>(map) + offset[sn];
+}
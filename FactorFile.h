@@ -0,0 +1,69 @@
+#ifndef FACTOR_FILE_H
+#define FACTOR_FILE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// File where the columns of L are stored, for the out-of-core factorisation.
+// The columns of the supernodes are stored one after the other, in postorder,
+// so that the forward and backward solves read the file sequentially.
+// Columns are written by a background thread while the factorisation goes on
+// (write-behind), and their memory is freed once written. Write blocks while
+// the columns waiting to be written take more than the memory limit.
+// After Finish, the file is mapped into memory, and the operating system reads
+// the columns back on demand during the solves.
+class FactorFile {
+  int fd = -1;
+
+  // position of the columns of each supernode in the file, in doubles
+  std::vector<size_t> offset{};
+
+  // columns waiting to be written, and their size in bytes
+  std::deque<std::pair<int, std::vector<double>*>> queue{};
+  size_t queued_bytes{};
+  size_t memory_limit{};
+
+  std::thread writer{};
+  std::mutex mutex{};
+  std::condition_variable cv_queue{};
+  std::condition_variable cv_space{};
+  bool stop = false;
+  int status{};
+
+  // file mapped into memory
+  void* map = nullptr;
+  size_t map_size{};
+
+  void WriterLoop();
+  void Close();
+
+ public:
+  ~FactorFile();
+
+  // Create the file and start the writer. size[sn] is the number of entries
+  // of the columns of supernode sn. If file_name is empty, a temporary file is
+  // created in TMPDIR (or /tmp), and removed when the object is destroyed.
+  int Open(const std::string& file_name, const std::vector<size_t>& size,
+           size_t memory_limit_input);
+
+  // Queue the columns of supernode sn to be written. columns is freed once
+  // written, and must not be used in the meantime.
+  void Write(int sn, std::vector<double>& columns);
+
+  // Wait for all the columns to be written, stop the writer and map the file
+  int Finish();
+
+  // columns of supernode sn, after Finish
+  const double* Columns(int sn) const;
+
+  // size of the file
+  size_t Bytes() const {
+    return offset.empty() ? 0 : offset.back() * sizeof(double);
+  }
+};
+
+#endif
@@ -1,7 +1,43 @@
 #include "Factorise.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 
+static inline void ExtendAdd(int length, const double* x, int incx, double* y,
+                             int incy) {
+  // Sum length entries of x into y, with the given strides.
+  // Runs of consecutive indices are often very short, so a loop that the
+  // compiler can vectorise is cheaper than a call to daxpy_.
+  if (incx == 1 && incy == 1) {
+    for (int k = 0; k < length; ++k) y[k] += x[k];
+  } else {
+    for (int k = 0; k < length; ++k) y[k * incy] += x[k * incx];
+  }
+}
+
+static void RunOnPool(void* pool, int n, void (*task)(int, void*),
+                      void* data) {
+  // Executes the tasks of the parallel dense kernels on the scheduler
+  static_cast<Scheduler*>(pool)->ParallelFor(
+      n, [task, data](int i) { task(i, data); });
+}
+
+// names of the phases of a supernode and of the dense kernels
+static const char* k_phase_names[tr_size] = {
+    "prepare", "assemble original", "assemble into frontal", "factorise",
+    "assemble into clique"};
+static const char* k_kernel_names[t_size] = {
+    "trsm", "syrk", "gemm", "fact", "copy", "copy sch", "scal", "convert"};
+
+static void PrintCounters(const char* name, const double* counters) {
+  // cycles, instructions per cycle and misses of a phase or kernel
+  const double cycles = counters[hc_cycles];
+  printf("\t  %-22s %10.3e %6.2f %10.3e %10.3e\n", name, cycles,
+         cycles > 0.0 ? counters[hc_instructions] / cycles : 0.0,
+         counters[hc_llc_misses], counters[hc_dtlb_misses]);
+}
+
 Factorise::Factorise(const Symbolic& S_input,
                      const std::vector<int>& rowsA_input,
                      const std::vector<int>& ptrA_input,
@@ -33,22 +69,105 @@ Factorise::Factorise(const Symbolic& S_input,
   // Double transpose to sort columns
   std::vector<int> temp_ptr(n + 1);
   std::vector<int> temp_rows(nzA);
-  std::vector<double> temp_val(nzA);
-  Transpose(ptrA, rowsA, valA, temp_ptr, temp_rows, temp_val);
-  Transpose(temp_ptr, temp_rows, temp_val, ptrA, rowsA, valA);
+  std::vector<int> temp_origin(nzA);
+  Transpose(ptrA, rowsA, originA, temp_ptr, temp_rows, temp_origin);
+  Transpose(temp_ptr, temp_rows, temp_origin, ptrA, rowsA, originA);
+
+  // position of each entry in the frontal matrix of its supernode
+  frontalA.resize(nzA);
+  for (int sn = 0; sn < S.Sn(); ++sn) {
+    const int sn_begin = S.SnStart(sn);
+    const int ldf = S.Ptr(sn + 1) - S.Ptr(sn);
+
+    for (int j = 0; j < S.SnStart(sn + 1) - sn_begin; ++j) {
+      for (int el = ptrA[sn_begin + j]; el < ptrA[sn_begin + j + 1]; ++el) {
+        // relative row index in the frontal matrix
+        const int i = S.RelindCols(el);
+
+        switch (S.Packed()) {
+          case PackType::Full:
+            frontalA[el] = i + j * ldf;
+            break;
+          case PackType::Hybrid:
+          case PackType::Hybrid2:
+            frontalA[el] = i + j * ldf - j * (j + 1) / 2;
+            break;
+        }
+      }
+    }
+  }
 
   // create linked lists of children in supernodal elimination tree
   ChildrenLinkedList(S.SnParent(), firstChildren, nextChildren);
 
-  // allocate space for list of generated elements and columns of L
+  // allocate space for list of generated elements
   SchurContribution.resize(S.Sn(), nullptr);
-  SnColumns.resize(S.Sn());
+
+  // size of the cliques
+  clique_size.resize(S.Sn());
+  clique_owner.resize(S.Sn());
+  clique_block_start.clear();
+  clique_block_ptr.assign(S.Sn() + 1, 0);
+  for (int sn = 0; sn < S.Sn(); ++sn) {
+    const int ldc =
+        S.Ptr(sn + 1) - S.Ptr(sn) - (S.SnStart(sn + 1) - S.SnStart(sn));
+
+    clique_block_ptr[sn] = clique_block_start.size();
+
+    switch (S.Packed()) {
+      case PackType::Full:
+        clique_size[sn] = ldc * ldc;
+        break;
+
+      case PackType::Hybrid2:
+      case PackType::Hybrid: {
+        if (ldc == 0) {
+          clique_size[sn] = 0;
+          break;
+        }
+        const int nb = S.BlockSize();
+        const int n_blocks = (ldc - 1) / nb + 1;
+        int schur_size{};
+        for (int j = 0; j < n_blocks; ++j) {
+          clique_block_start.push_back(schur_size);
+          const int jb = std::min(nb, ldc - j * nb);
+          schur_size += (ldc - j * nb) * jb;
+        }
+        clique_block_start.push_back(schur_size);
+        clique_size[sn] = schur_size;
+      } break;
+    }
+  }
+  clique_block_ptr[S.Sn()] = clique_block_start.size();
+
+  // Size of the stack of cliques needed to process the subtree of each
+  // supernode in postorder. This uses the same recurrence as the storage in
+  // Analyse::ReorderChildren, but counts only the cliques.
+  std::vector<double> subtree_stack(S.Sn());
+  for (int sn = 0; sn < S.Sn(); ++sn) {
+    double children_cliques{};
+    double peak{};
+    for (int child = firstChildren[sn]; child != -1;
+         child = nextChildren[child]) {
+      peak = std::max(peak, children_cliques + subtree_stack[child]);
+      children_cliques += clique_size[child];
+    }
+    subtree_stack[sn] = std::max(peak, children_cliques + clique_size[sn]);
+
+    if (S.SnParent()[sn] == -1) {
+      stack_size_tree = std::max(stack_size_tree, subtree_stack[sn]);
+    }
+  }
+  for (int root : S.Layer0()) {
+    stack_size_layer0 = std::max(stack_size_layer0, subtree_stack[root]);
+  }
 }
 
 void Factorise::Permute(const std::vector<int>& iperm) {
   // Symmetric permutation of the lower triangular matrix A based on inverse
   // permutation iperm.
   // The resulting matrix is lower triangular, regardless of the input matrix.
+  // Values are not moved: originA stores the position in valA of each entry.
 
   std::vector<int> work(n, 0);
 
@@ -80,7 +199,7 @@ void Factorise::Permute(const std::vector<int>& iperm) {
   Counts2Ptr(new_ptr, work);
 
   std::vector<int> new_rows(new_ptr.back());
-  std::vector<double> new_val(new_ptr.back());
+  std::vector<int> new_origin(new_ptr.back());
 
   // go through the columns to assign row indices
   for (int j = 0; j < n; ++j) {
@@ -103,21 +222,308 @@ void Factorise::Permute(const std::vector<int>& iperm) {
 
       int pos = work[actual_col]++;
       new_rows[pos] = actual_row;
-      new_val[pos] = valA[el];
+      new_origin[pos] = el;
     }
   }
 
   ptrA = std::move(new_ptr);
   rowsA = std::move(new_rows);
-  valA = std::move(new_val);
+  originA = std::move(new_origin);
+}
+
+size_t Factorise::SnColumnsSize(int sn) const {
+  // number of entries of the columns of supernode sn in the factor
+  const size_t sn_size = S.SnStart(sn + 1) - S.SnStart(sn);
+  const size_t ldf = S.Ptr(sn + 1) - S.Ptr(sn);
+  if (S.Packed() == PackType::Full) return ldf * sn_size;
+  return ldf * sn_size - sn_size * (sn_size - 1) / 2;
+}
+
+void Factorise::AssembleChildFrontal(int sn, int child_sn,
+                                     double* frontal) const {
+  // Sum the columns of the Schur contribution of child_sn that belong to the
+  // supernode sn into frontal.
+
+  const int sn_size = S.SnStart(sn + 1) - S.SnStart(sn);
+  const int ldf = S.Ptr(sn + 1) - S.Ptr(sn);
+  const double* child_clique = SchurContribution[child_sn];
+
+  // determine size of clique of child
+  const int child_begin = S.SnStart(child_sn);
+  const int child_end = S.SnStart(child_sn + 1);
+
+  // number of nodes in child sn
+  const int child_size = child_end - child_begin;
+
+  // size of clique of child sn
+  const int nc = S.Ptr(child_sn + 1) - S.Ptr(child_sn) - child_size;
+
+  // runs of consecutive indices in the clique of the child
+  const CliqueRun* runs = S.CliqueRuns(child_sn);
+  const int n_runs = S.CliqueRunsCount(child_sn);
+  int first_run{};
+
+  // go through the columns of the contribution of the child
+  for (int col = 0; col < nc; ++col) {
+    // relative index of column in the frontal matrix
+    const int j = S.RelindClique(child_sn, col);
+
+    // Relative indices are increasing, so the remaining columns belong to
+    // clique and are assembled by AssembleChildClique.
+    if (j >= sn_size) break;
+
+    // skip the runs that are above the diagonal
+    while (runs[first_run].source + runs[first_run].length <= col)
+      ++first_run;
+
+    // information about the column of the child, for the hybrid formats
+    const int nb = S.BlockSize();
+    const int jblock = col / nb;
+    const int col_ = col - jblock * nb;
+    const int start_block =
+        S.Packed() == PackType::Full
+            ? 0
+            : clique_block_start[clique_block_ptr[child_sn] + jblock];
+
+    // go through the runs of rows of the contribution of the child.
+    // The first run may start above the diagonal.
+    for (int r = first_run; r < n_runs; ++r) {
+      const int row = std::max(runs[r].source, col);
+      const int length = runs[r].source + runs[r].length - row;
+
+      // relative index of the entry in the matrix frontal
+      const int i = runs[r].dest + row - runs[r].source;
+
+      switch (S.Packed()) {
+        case PackType::Full:
+          ExtendAdd(length, &child_clique[row + nc * col], 1,
+                    &frontal[i + ldf * j], 1);
+          break;
+
+        case PackType::Hybrid2: {
+          const int jb = std::min(nb, nc - nb * jblock);
+          const int row_ = row - jblock * nb;
+          ExtendAdd(length, &child_clique[start_block + col_ + jb * row_],
+                    jb, &frontal[i + ldf * j - j * (j + 1) / 2], 1);
+        } break;
+
+        case PackType::Hybrid: {
+          const int row_ = row - jblock * nb;
+          const int ld = nc - nb * jblock;
+          ExtendAdd(length, &child_clique[start_block + row_ + ld * col_], 1,
+                    &frontal[i + ldf * j - j * (j + 1) / 2], 1);
+        } break;
+      }
+    }
+  }
+}
+
+void Factorise::AssembleChildClique(int sn, int child_sn,
+                                    double* clique) const {
+  // Sum the columns of the Schur contribution of child_sn that do not belong
+  // to the supernode sn into clique.
+
+  const int sn_size = S.SnStart(sn + 1) - S.SnStart(sn);
+  const int ldc = S.Ptr(sn + 1) - S.Ptr(sn) - sn_size;
+  const double* child_clique = SchurContribution[child_sn];
+
+  // determine size of clique of child
+  const int child_begin = S.SnStart(child_sn);
+  const int child_end = S.SnStart(child_sn + 1);
+
+  // number of nodes in child sn
+  const int child_size = child_end - child_begin;
+
+  // size of clique of child sn
+  const int nc = S.Ptr(child_sn + 1) - S.Ptr(child_sn) - child_size;
+
+  // runs of consecutive indices in the clique of the child
+  const CliqueRun* runs = S.CliqueRuns(child_sn);
+  const int n_runs = S.CliqueRunsCount(child_sn);
+
+  if (S.Packed() != PackType::Hybrid2) {
+    //   if (true) {
+    int first_run{};
+
+    //   go through the columns of the contribution of the child
+    for (int col = 0; col < nc; ++col) {
+      // relative index of column in the frontal matrix
+      int j = S.RelindClique(child_sn, col);
+
+      // j < sn_size was already done before, because it was needed before the
+      // partial factorisation. Assembling into the clique instead can be done
+      // after.
+      if (j < sn_size) continue;
+
+      // adjust relative index to access clique
+      j -= sn_size;
+
+      // skip the runs that are above the diagonal
+      while (runs[first_run].source + runs[first_run].length <= col)
+        ++first_run;
+
+      // information about the column of the child and of the current clique,
+      // for the hybrid formats
+      const int nb = S.BlockSize();
+      const int jblock_c = col / nb;
+      const int jb_c = std::min(nb, nc - nb * jblock_c);
+      const int col_ = col - jblock_c * nb;
+      const int ld_c = nc - nb * jblock_c;
+      const int jblock = j / nb;
+      const int jb = std::min(nb, ldc - nb * jblock);
+      const int j_ = j - jblock * nb;
+      const int ld = ldc - nb * jblock;
+      const bool full = S.Packed() == PackType::Full;
+      const int start_block_c =
+          full ? 0 : clique_block_start[clique_block_ptr[child_sn] + jblock_c];
+      const int start_block =
+          full ? 0 : clique_block_start[clique_block_ptr[sn] + jblock];
+
+      // go through the runs of rows of the contribution of the child.
+      // The first run may start above the diagonal.
+      for (int r = first_run; r < n_runs; ++r) {
+        const int row = std::max(runs[r].source, col);
+        const int length = runs[r].source + runs[r].length - row;
+
+        // relative index of the entry in the matrix clique
+        const int i = runs[r].dest + row - runs[r].source - sn_size;
+
+        const int row_ = row - jblock_c * nb;
+        const int i_ = i - jblock * nb;
+
+        switch (S.Packed()) {
+          case PackType::Full:
+            ExtendAdd(length, &child_clique[row + nc * col], 1,
+                      &clique[i + ldc * j], 1);
+            break;
+
+          case PackType::Hybrid2:
+            ExtendAdd(length,
+                      &child_clique[start_block_c + col_ + jb_c * row_], jb_c,
+                      &clique[start_block + j_ + jb * i_], jb);
+            break;
+
+          case PackType::Hybrid:
+            ExtendAdd(length,
+                      &child_clique[start_block_c + row_ + ld_c * col_], 1,
+                      &clique[start_block + i_ + ld * j_], 1);
+            break;
+        }
+      }
+    }
+  } else {
+    // assemble the child clique into the current clique by blocks of columns.
+    // within a block, assemble by rows.
+
+    const int nb = S.BlockSize();
+    const int n_blocks = (nc - 1) / nb + 1;
+
+    int row_start{};
+    int first_run{};
+
+    // go through the blocks of columns of the child sn
+    for (int b = 0; b < n_blocks; ++b) {
+      const int start_block_c =
+          clique_block_start[clique_block_ptr[child_sn] + b];
+      const int jb_c = std::min(nb, nc - nb * b);
+
+      const int col_start = row_start;
+      const int col_end = std::min(col_start + nb, nc);
+
+      // first run that contains columns of this block
+      while (runs[first_run].source + runs[first_run].length <= col_start)
+        ++first_run;
+
+      // go through the rows within this block
+      for (int row = row_start; row < nc; ++row) {
+        const int i = S.RelindClique(child_sn, row) - sn_size;
+
+        // already assembled into frontal
+        if (i < 0) continue;
+
+        // the upper right part of the diagonal block stores zeros
+        const int col_last = std::min(col_end, row + 1);
+        const int row_ = row - b * nb;
+
+        // go through the runs of columns of the block
+        for (int r = first_run;
+             r < n_runs && runs[r].source < col_last; ++r) {
+          int col = std::max(runs[r].source, col_start);
+          const int run_end = std::min(runs[r].source + runs[r].length,
+                                       col_last);
+
+          // skip the columns that were assembled into frontal
+          const int j_first = runs[r].dest + col - runs[r].source;
+          if (j_first < sn_size) col += sn_size - j_first;
+
+          // sum consecutive entries in a row, without crossing the edge of a
+          // block of the parent
+          while (col < run_end) {
+            const int j = runs[r].dest + col - runs[r].source - sn_size;
+            const int jblock = j / nb;
+            const int col_end_parent = std::min((jblock + 1) * nb, ldc);
+            const int length = std::min(run_end - col, col_end_parent - j);
+
+            // information and sizes of current sn
+            const int jb = std::min(nb, ldc - nb * jblock);
+            const int i_ = i - jblock * nb;
+            const int j_ = j - jblock * nb;
+            const int start_block =
+                clique_block_start[clique_block_ptr[sn] + jblock];
+            const int col_ = col - b * nb;
+
+            ExtendAdd(length,
+                      &child_clique[start_block_c + col_ + jb_c * row_], 1,
+                      &clique[start_block + j_ + jb * i_], 1);
+
+            col += length;
+          }
+        }
+      }
+
+      row_start += nb;
+    }
+  }
+}
+
+PhaseStart Factorise::StartPhase() const {
+  PhaseStart start;
+  if (instrumentation >= instr_counters) Instr_ReadCounters(start.counts);
+  if (instrumentation >= instr_phase) start.ticks = Instr_Ticks();
+  return start;
+}
+
+double Factorise::StopPhase(const PhaseStart& start, int sn, int thread,
+                            trace_phase phase) {
+  // Return the time of the phase of supernode sn, started at start, and add
+  // its hardware counters to those of the thread. If tracing, the phase is
+  // also recorded by the thread that processed it.
+  if (instrumentation < instr_phase) return 0.0;
+  const uint64_t end = Instr_Ticks();
+  if (instrumentation >= instr_counters) {
+    uint64_t counts[hc_size];
+    Instr_ReadCounters(counts);
+    double* counters = &thread_times[thread].phase_counters[phase * hc_size];
+    for (int c = 0; c < hc_size; ++c)
+      counters[c] += counts[c] - start.counts[c];
+  }
+  if (trace) {
+    thread_times[thread].trace.push_back(
+        {sn, phase, Instr_Seconds(trace_origin, start.ticks),
+         Instr_Seconds(trace_origin, end)});
+  }
+  return Instr_Seconds(start.ticks, end);
 }
 
-int Factorise::ProcessSupernode(int sn) {
+int Factorise::ProcessSupernode(int sn, int thread) {
   // Assemble frontal matrix for supernode sn, perform partial factorisation and
   // store the result.
-  Clock clock;
+  // thread is the index of the thread that is processing the supernode.
+  PhaseStart start;
+  ThreadTimes& times = thread_times[thread];
+  Instr_SetKernelCounters(times.dense_counters.data());
 
-  clock.start();
+  start = StartPhase();
   // ===================================================
   // Supernode information
   // ===================================================
@@ -139,76 +545,48 @@ int Factorise::ProcessSupernode(int sn) {
   // undergo Cholesky elimination.
   // clique is ldc x ldc and stores the remaining (ldf - sn_size) columns
   // (without the top part), that do not undergo Cholesky elimination.
-  std::vector<double>& frontal = SnColumns[sn];
+  // With single precision, frontal is a workspace and the factor is stored
+  // separately.
+  std::vector<double>& frontal =
+      precision == PrecType::Single ? frontal_work[thread] : SnColumns[sn];
   double*& clique = SchurContribution[sn];
 
-  // frontal is initialized to zero
-  switch (S.Packed()) {
-    case PackType::Full:
-      frontal.resize(ldf * sn_size, 0.0);
-      break;
-    case PackType::Hybrid:
-    case PackType::Hybrid2:
-      frontal.resize(ldf * sn_size - sn_size * (sn_size - 1) / 2, 0.0);
-      break;
-  }
+  // frontal is initialized to zero, reusing the memory of a previous
+  // factorisation, if any
+  const size_t frontal_capacity = frontal.capacity();
+  frontal.assign(SnColumnsSize(sn), 0.0);
+  Mem_Add(precision == PrecType::Single ? mem_workspace : mem_factor,
+          (frontal.capacity() - frontal_capacity) * sizeof(double));
 
   // clique need not be initialized to zero, provided that the assembly is done
-  // properly
-  switch (S.Packed()) {
-    case PackType::Full:
-      if (ldc > 0) clique = new double[ldc * ldc];
-      break;
-
-    case PackType::Hybrid2:
-    case PackType::Hybrid: {
-      const int nb = S.BlockSize();
-      const int n_blocks = (ldc - 1) / nb + 1;
-      clique_block_start[sn].resize(n_blocks + 1);
-      int schur_size{};
-      for (int j = 0; j < n_blocks; ++j) {
-        clique_block_start[sn][j] = schur_size;
-        const int jb = std::min(nb, ldc - j * nb);
-        schur_size += (ldc - j * nb) * jb;
-      }
-      clique_block_start[sn].back() = schur_size;
-      clique = new double[schur_size];
-    } break;
+  // properly, after the partial factorisation. It is taken from the stack of
+  // cliques of this thread.
+  // With single pass assembly, the children are summed into clique before the
+  // partial factorisation, so clique starts from zero and the dense kernels
+  // add the Schur complement to it.
+  if (clique_size[sn] > 0) {
+    clique = clique_stacks[thread]->Push(clique_size[sn]);
+    clique_owner[sn] = thread;
+    if (assembly == AssemblyType::SinglePass)
+      std::fill_n(clique, clique_size[sn], 0.0);
   }
 
-  time_prepare += clock.stop();
+  times.prepare += StopPhase(start, sn, thread, tr_prepare);
 
-  clock.start();
+  start = StartPhase();
   // ===================================================
   // Assemble original matrix A into frontal
   // ===================================================
-  // j is relative column index in the frontal matrix
-  for (int j = 0; j < sn_size; ++j) {
-    // column index in the original matrix
-    const int col = sn_begin + j;
-
-    // go through the column
-    for (int el = ptrA[col]; el < ptrA[col + 1]; ++el) {
-      // relative row index in the frontal matrix
-      const int i = S.RelindCols(el);
-
-      switch (S.Packed()) {
-        case PackType::Full:
-          frontal[i + j * ldf] = valA[el];
-          break;
-        case PackType::Hybrid:
-        case PackType::Hybrid2:
-          frontal[i + j * ldf - j * (j + 1) / 2] = valA[el];
-          break;
-      }
-    }
+  // values are scattered directly from the original ordering
+  for (int el = ptrA[sn_begin]; el < ptrA[sn_end]; ++el) {
+    frontal[frontalA[el]] = valA[originA[el]];
   }
-  time_assemble_original += clock.stop();
+  times.assemble_original += StopPhase(start, sn, thread, tr_assemble_original);
 
   // ===================================================
   // Assemble frontal matrices of children into frontal
   // ===================================================
-  clock.start();
+  start = StartPhase();
   int child_sn = firstChildren[sn];
   while (child_sn != -1) {
     // Schur contribution of the current child
@@ -218,137 +596,136 @@ int Factorise::ProcessSupernode(int sn) {
       return ret_generic;
     }
 
-    // determine size of clique of child
-    const int child_begin = S.SnStart(child_sn);
-    const int child_end = S.SnStart(child_sn + 1);
-
-    // number of nodes in child sn
-    const int child_size = child_end - child_begin;
-
-    // size of clique of child sn
-    const int nc = S.Ptr(child_sn + 1) - S.Ptr(child_sn) - child_size;
-
-    // go through the columns of the contribution of the child
-    for (int col = 0; col < nc; ++col) {
-      // relative index of column in the frontal matrix
-      int j = S.RelindClique(child_sn, col);
-
-      if (j < sn_size) {
-        // assemble into frontal
-
-        // go through the rows of the contribution of the child
-        int row = col;
-        while (row < nc) {
-          // relative index of the entry in the matrix frontal
-          const int i = S.RelindClique(child_sn, row);
-
-          // how many entries to sum
-          const int consecutive = S.ConsecutiveSums(child_sn, row);
-
-          // use daxpy_ for summing consecutive entries
-          const int i_one = 1;
-          const double d_one = 1.0;
-          switch (S.Packed()) {
-            case PackType::Full:
-              daxpy_(&consecutive, &d_one, &child_clique[row + nc * col],
-                     &i_one, &frontal[i + ldf * j], &i_one);
-              break;
-
-            case PackType::Hybrid2: {
-              const int nb = S.BlockSize();
-              const int jblock = col / nb;
-              const int jb = std::min(nb, nc - nb * jblock);
-              const int row_ = row - jblock * nb;
-              const int col_ = col - jblock * nb;
-              const int start_block = clique_block_start[child_sn][jblock];
-              daxpy_(&consecutive, &d_one,
-                     &child_clique[start_block + col_ + jb * row_], &jb,
-                     &frontal[i + ldf * j - j * (j + 1) / 2], &i_one);
-            } break;
-
-            case PackType::Hybrid: {
-              const int nb = S.BlockSize();
-              const int jblock = col / nb;
-              const int row_ = row - jblock * nb;
-              const int col_ = col - jblock * nb;
-              const int start_block = clique_block_start[child_sn][jblock];
-              const int ld = nc - nb * jblock;
-              daxpy_(&consecutive, &d_one,
-                     &child_clique[start_block + row_ + ld * col_], &i_one,
-                     &frontal[i + ldf * j - j * (j + 1) / 2], &i_one);
-            } break;
-          }
-          row += consecutive;
-        }
-      }
-
-      // If j >= sn_size, we would assemble into clique.
-      // This is delayed until after the partial factorisation, to avoid
-      // having to initialize clique to zero.
+    AssembleChildFrontal(sn, child_sn, frontal.data());
+
+    if (assembly == AssemblyType::SinglePass) {
+      // the child is assembled into clique while it is still in cache
+      times.assemble_children_F +=
+          StopPhase(start, sn, thread, tr_assemble_children_F);
+      start = StartPhase();
+      if (clique) AssembleChildClique(sn, child_sn, clique);
+      times.assemble_children_C +=
+          StopPhase(start, sn, thread, tr_assemble_children_C);
+      start = StartPhase();
+
+      // Schur contribution of the child is no longer needed
+      clique_stacks[clique_owner[child_sn]]->Release(child_clique);
+      SchurContribution[child_sn] = nullptr;
     }
 
     // move on to the next child
     child_sn = nextChildren[child_sn];
   }
-  time_assemble_children_F += clock.stop();
+
+  // the space of the cliques of the children is recovered
+  if (assembly == AssemblyType::SinglePass && clique)
+    clique = clique_stacks[thread]->Compact(clique);
+
+  times.assemble_children_F +=
+      StopPhase(start, sn, thread, tr_assemble_children_F);
 
   // ===================================================
   // Partial factorisation
   // ===================================================
-  clock.start();
-  switch (S.Packed()) {
-    case PackType::Full:
-      if (S.Type() == FactType::NormEq) {
-        int status = DenseFact_pdbf(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                    ldf, clique, ldc, times_dense_fact.data());
-        if (status) return status;
+  start = StartPhase();
 
+  // large fronts are factorised with the parallel kernels
+  const DenseFact_par par{RunOnPool, pool.get(), pool->Threads()};
+  const bool par_node =
+      pool->Threads() > 1 && (double)ldf * ldf * sn_size >= k_par_node_ops;
+
+  // the Schur complement overwrites clique, or is added to the contributions
+  // of the children already assembled into it
+  const double schur_beta = assembly == AssemblyType::SinglePass ? 1.0 : 0.0;
+
+  // pivots of the supernode, for static pivoting
+  const DenseFact_piv piv_sn{&sign_perm[sn_begin], &reg_perm[sn_begin],
+                             pivot_thresh, pivot_delta};
+  const DenseFact_piv* piv = static_pivoting ? &piv_sn : nullptr;
+
+  switch (S.Packed()) {
+    case PackType::Full: {
+      int status;
+      if (precision == PrecType::Single) {
+        status = FactoriseSingle(sn, thread, frontal, clique, schur_beta, piv);
+      } else if (S.Type() == FactType::NormEq) {
+        status = par_node ? DenseFact_pdbf_par(ldf, sn_size, S.BlockSize(),
+                                               frontal.data(), ldf, clique, ldc,
+                                               schur_beta, piv,
+                                               times.dense_fact.data(), &par)
+                          : DenseFact_pdbf(ldf, sn_size, S.BlockSize(),
+                                           frontal.data(), ldf, clique, ldc,
+                                           schur_beta, piv,
+                                           times.dense_fact.data());
       } else {
-        int status = DenseFact_pibf(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                    ldf, clique, ldc, times_dense_fact.data());
-        if (status) return status;
+        status = par_node ? DenseFact_pibf_par(ldf, sn_size, S.BlockSize(),
+                                               frontal.data(), ldf, clique, ldc,
+                                               schur_beta, piv,
+                                               times.dense_fact.data(), &par)
+                          : DenseFact_pibf(ldf, sn_size, S.BlockSize(),
+                                           frontal.data(), ldf, clique, ldc,
+                                           schur_beta, piv,
+                                           times.dense_fact.data());
       }
-      break;
+      if (status) return status;
+    } break;
 
     case PackType::Hybrid2: {
       int status = DenseFact_l2h(frontal.data(), ldf, sn_size, S.BlockSize(),
-                                 times_dense_fact.data());
+                                 times.dense_fact.data());
       if (status) return status;
 
       if (S.Type() == FactType::NormEq) {
         status = DenseFact_pdbh_2(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                  clique, times_dense_fact.data());
+                                  clique, schur_beta, piv,
+                                  times.dense_fact.data());
         if (status) return status;
       } else {
         status = DenseFact_pibh_2(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                  clique, times_dense_fact.data());
+                                  clique, schur_beta, piv,
+                                  times.dense_fact.data());
         if (status) return status;
       }
     } break;
 
     case PackType::Hybrid: {
       int status = DenseFact_l2h(frontal.data(), ldf, sn_size, S.BlockSize(),
-                                 times_dense_fact.data());
+                                 times.dense_fact.data());
       if (status) return status;
 
       if (S.Type() == FactType::NormEq) {
-        status = DenseFact_pdbh(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                clique, times_dense_fact.data());
-        if (status) return status;
+        status = par_node ? DenseFact_pdbh_par(ldf, sn_size, S.BlockSize(),
+                                               frontal.data(), clique,
+                                               schur_beta, piv,
+                                               times.dense_fact.data(), &par)
+                          : DenseFact_pdbh(ldf, sn_size, S.BlockSize(),
+                                           frontal.data(), clique, schur_beta,
+                                           piv, times.dense_fact.data());
       } else {
-        status = DenseFact_pibh(ldf, sn_size, S.BlockSize(), frontal.data(),
-                                clique, times_dense_fact.data());
-        if (status) return status;
+        status = par_node ? DenseFact_pibh_par(ldf, sn_size, S.BlockSize(),
+                                               frontal.data(), clique,
+                                               schur_beta, piv,
+                                               times.dense_fact.data(), &par)
+                          : DenseFact_pibh(ldf, sn_size, S.BlockSize(),
+                                           frontal.data(), clique, schur_beta,
+                                           piv, times.dense_fact.data());
       }
+      if (status) return status;
     } break;
   }
 
-  time_factorise += clock.stop();
+  times.factorise += StopPhase(start, sn, thread, tr_factorise);
+
+  // the columns of sn are final, and can be written to the file while the
+  // factorisation goes on
+  if (factor_file_ptr) factor_file_ptr->Write(sn, frontal);
+
+  if (assembly == AssemblyType::SinglePass) return ret_ok;
 
   // ===================================================
   // Assemble frontal matrices of children into clique
   // ===================================================
-  clock.start();
+  start = StartPhase();
   child_sn = firstChildren[sn];
   while (child_sn != -1) {
     // Schur contribution of the current child
@@ -358,184 +735,67 @@ int Factorise::ProcessSupernode(int sn) {
       return ret_generic;
     }
 
-    // determine size of clique of child
-    const int child_begin = S.SnStart(child_sn);
-    const int child_end = S.SnStart(child_sn + 1);
-
-    // number of nodes in child sn
-    const int child_size = child_end - child_begin;
-
-    // size of clique of child sn
-    const int nc = S.Ptr(child_sn + 1) - S.Ptr(child_sn) - child_size;
-
-    if (S.Packed() != PackType::Hybrid2) {
-      //   if (true) {
-      //   go through the columns of the contribution of the child
-      for (int col = 0; col < nc; ++col) {
-        // relative index of column in the frontal matrix
-        int j = S.RelindClique(child_sn, col);
-
-        if (j >= sn_size) {
-          // assemble into clique
-
-          // adjust relative index to access clique
-          j -= sn_size;
-
-          // go through the rows of the contribution of the child
-          int row = col;
-          while (row < nc) {
-            // relative index of the entry in the matrix clique
-            const int i = S.RelindClique(child_sn, row) - sn_size;
-
-            // how many entries to sum
-            const int consecutive = S.ConsecutiveSums(child_sn, row);
-
-            // use daxpy_ for summing consecutive entries
-            const int i_one = 1;
-            const double d_one = 1.0;
-            switch (S.Packed()) {
-              case PackType::Full:
-                daxpy_(&consecutive, &d_one, &child_clique[row + nc * col],
-                       &i_one, &clique[i + ldc * j], &i_one);
-                break;
-
-              case PackType::Hybrid2: {
-                const int nb = S.BlockSize();
-                const int jblock_c = col / nb;
-                const int jb_c = std::min(nb, nc - nb * jblock_c);
-                const int row_ = row - jblock_c * nb;
-                const int col_ = col - jblock_c * nb;
-                const int start_block_c =
-                    clique_block_start[child_sn][jblock_c];
-
-                const int jblock = j / nb;
-                const int jb = std::min(nb, ldc - nb * jblock);
-                const int i_ = i - jblock * nb;
-                const int j_ = j - jblock * nb;
-                const int start_block = clique_block_start[sn][jblock];
-
-                daxpy_(&consecutive, &d_one,
-                       &child_clique[start_block_c + col_ + jb_c * row_], &jb_c,
-                       &clique[start_block + j_ + jb * i_], &jb);
-              } break;
-
-              case PackType::Hybrid: {
-                const int nb = S.BlockSize();
-                const int jblock_c = col / nb;
-                const int jb_c = std::min(nb, nc - nb * jblock_c);
-                const int row_ = row - jblock_c * nb;
-                const int col_ = col - jblock_c * nb;
-                const int start_block_c =
-                    clique_block_start[child_sn][jblock_c];
-                const int ld_c = nc - nb * jblock_c;
-
-                const int jblock = j / nb;
-                const int jb = std::min(nb, ldc - nb * jblock);
-                const int i_ = i - jblock * nb;
-                const int j_ = j - jblock * nb;
-                const int start_block = clique_block_start[sn][jblock];
-                const int ld = ldc - nb * jblock;
-
-                daxpy_(&consecutive, &d_one,
-                       &child_clique[start_block_c + row_ + ld_c * col_],
-                       &i_one, &clique[start_block + i_ + ld * j_], &i_one);
-              } break;
-            }
-            row += consecutive;
-          }
-        }
+    AssembleChildClique(sn, child_sn, clique);
 
-        // j < sn_size was already done before, because it was needed before the
-        // partial factorisation. Assembling into the clique instead can be done
-        // after.
-      }
-    } else {
-      // assemble the child clique into the current clique by blocks of columns.
-      // within a block, assemble by rows.
-
-      const int nb = S.BlockSize();
-      const int n_blocks = (nc - 1) / nb + 1;
-
-      int row_start{};
-
-      // go through the blocks of columns of the child sn
-      for (int b = 0; b < n_blocks; ++b) {
-        const int b_start = clique_block_start[child_sn][b];
-
-        const int col_start = row_start;
-        const int col_end = std::min(col_start + nb, nc);
-
-        // go through the rows within this block
-        for (int row = row_start; row < nc; ++row) {
-          const int i = S.RelindClique(child_sn, row) - sn_size;
-
-          // already assembled into frontal
-          if (i < 0) continue;
-
-          // go through the columns of the block
-          int col = col_start;
-          while (col < col_end) {
-            int j = S.RelindClique(child_sn, col);
-            if (j < sn_size) {
-              ++col;
-              continue;
-            }
-            j -= sn_size;
-
-            // information and sizes of child sn
-            const int jblock_c = b;
-            const int jb_c = std::min(nb, nc - nb * jblock_c);
-            const int row_ = row - jblock_c * nb;
-            const int col_ = col - jblock_c * nb;
-            const int start_block_c = b_start;
-
-            // sun consecutive entries in a row.
-            // consecutive need to be reduced, to account for edge of the block
-            const int zeros_stored_row =
-                std::max(0, jb_c - (row - row_start) - 1);
-            int consecutive = S.ConsecutiveSums(child_sn, col);
-            const int left_in_child = col_end - col - zeros_stored_row;
-            consecutive = std::min(consecutive, left_in_child);
-
-            // consecutive need to account also for edge of block in parent
-            const int block_in_parent = j / nb;
-            const int col_end_parent =
-                std::min((block_in_parent + 1) * nb, ldc);
-            const int left_in_parent = col_end_parent - j;
-            consecutive = std::min(consecutive, left_in_parent);
-
-            // needed to deal with zeros stored in upper right part of block
-            if (consecutive == 0) break;
+    // Schur contribution of the child is no longer needed
+    clique_stacks[clique_owner[child_sn]]->Release(child_clique);
+    SchurContribution[child_sn] = nullptr;
 
-            // information and sizes of current sn
-            const int jblock = block_in_parent;
-            const int jb = std::min(nb, ldc - nb * jblock);
-            const int i_ = i - jblock * nb;
-            const int j_ = j - jblock * nb;
-            const int start_block = clique_block_start[sn][jblock];
+    // move on to the next child
+    child_sn = nextChildren[child_sn];
+  }
 
-            const double d_one = 1.0;
-            const int i_one = 1;
-            daxpy_(&consecutive, &d_one,
-                   &child_clique[start_block_c + col_ + jb_c * row_], &i_one,
-                   &clique[start_block + j_ + jb * i_], &i_one);
+  // the space of the cliques of the children is recovered
+  if (clique) clique = clique_stacks[thread]->Compact(clique);
 
-            col += consecutive;
-          }
-        }
+  times.assemble_children_C +=
+      StopPhase(start, sn, thread, tr_assemble_children_C);
 
-        row_start += nb;
-      }
-    }
+  return ret_ok;
+}
 
-    // Schur contribution of the child is no longer needed
-    delete[] child_clique;
+int Factorise::FactoriseSingle(int sn, int thread,
+                               const std::vector<double>& frontal,
+                               double* clique, double schur_beta,
+                               const DenseFact_piv* piv) {
+  // Partial factorisation of supernode sn in single precision.
+  // frontal is converted into the single precision factor, and the Schur
+  // complement is computed in single precision and converted back into
+  // clique. If schur_beta is 1, clique already contains the contributions of
+  // the children, which are converted as well.
+
+  const int sn_size = S.SnStart(sn + 1) - S.SnStart(sn);
+  const int ldf = S.Ptr(sn + 1) - S.Ptr(sn);
+  const int ldc = ldf - sn_size;
 
-    // move on to the next child
-    child_sn = nextChildren[child_sn];
+  std::vector<float>& frontal_s = SnColumnsSingle[sn];
+  const size_t frontal_capacity = frontal_s.capacity();
+  frontal_s.assign(frontal.begin(), frontal.end());
+  Mem_Add(mem_factor,
+          (frontal_s.capacity() - frontal_capacity) * sizeof(float));
+
+  std::vector<float>& clique_s = clique_work[thread];
+  if (clique_s.size() < clique_size[sn]) {
+    const size_t clique_capacity = clique_s.capacity();
+    clique_s.resize(clique_size[sn]);
+    Mem_Add(mem_workspace,
+            (clique_s.capacity() - clique_capacity) * sizeof(float));
   }
-  time_assemble_children_C += clock.stop();
+  if (schur_beta != 0.0) std::copy_n(clique, clique_size[sn], clique_s.begin());
+
+  // subnormals are flushed, the perturbation is corrected by refinement
+  FlushToZero ftz;
+
+  double* times = thread_times[thread].dense_fact.data();
+  const int status =
+      S.Type() == FactType::NormEq
+          ? DenseFact_pdbf_s(ldf, sn_size, S.BlockSize(), frontal_s.data(),
+                             ldf, clique_s.data(), ldc, schur_beta, piv, times)
+          : DenseFact_pibf_s(ldf, sn_size, S.BlockSize(), frontal_s.data(),
+                             ldf, clique_s.data(), ldc, schur_beta, piv, times);
+  if (status) return status;
 
+  std::copy_n(clique_s.begin(), clique_size[sn], clique);
   return ret_ok;
 }
 
@@ -545,7 +805,8 @@ bool Factorise::Check() const {
   // Return true if check is successful, or if matrix is too large.
   // To be used for debug.
 
-  if (S.Type() == FactType::AugSys || S.Packed() == PackType::Hybrid) {
+  if (S.Type() == FactType::AugSys || S.Packed() == PackType::Hybrid ||
+      factor_file_ptr) {
     printf("\n==> Dense check not available\n");
     return true;
   }
@@ -562,7 +823,7 @@ bool Factorise::Check() const {
       int row = rowsA[el];
 
       // insert element in position (row,col)
-      M[row + col * n] = valA[el];
+      M[row + col * n] = valA[originA[el]];
     }
   }
 
@@ -636,16 +897,35 @@ void Factorise::PrintTimes() const {
   printf("\t\tFactorise\n");
   printf("----------------------------------------------------\n");
   printf("\nFactorise time          \t%8.4f\n", time_total);
-  printf("\tPrepare:                %8.4f (%4.1f%%)\n", time_prepare,
-         time_prepare / time_total * 100);
-  printf("\tAssembly original:      %8.4f (%4.1f%%)\n", time_assemble_original,
-         time_assemble_original / time_total * 100);
-  printf("\tAssembly into frontal:  %8.4f (%4.1f%%)\n",
-         time_assemble_children_F, time_assemble_children_F / time_total * 100);
-  printf("\tAssembly into clique:   %8.4f (%4.1f%%)\n",
-         time_assemble_children_C, time_assemble_children_C / time_total * 100);
-  printf("\tDense factorisation:    %8.4f (%4.1f%%)\n", time_factorise,
-         time_factorise / time_total * 100);
+  if (instrumentation >= instr_phase) {
+    printf("\tPrepare:                %8.4f (%4.1f%%)\n", time_prepare,
+           time_prepare / time_total * 100);
+    printf("\tAssembly original:      %8.4f (%4.1f%%)\n",
+           time_assemble_original, time_assemble_original / time_total * 100);
+    printf("\tAssembly into frontal:  %8.4f (%4.1f%%)\n",
+           time_assemble_children_F,
+           time_assemble_children_F / time_total * 100);
+    printf("\tAssembly into clique:   %8.4f (%4.1f%%)\n",
+           time_assemble_children_C,
+           time_assemble_children_C / time_total * 100);
+    printf("\tDense factorisation:    %8.4f (%4.1f%%)\n", time_factorise,
+           time_factorise / time_total * 100);
+  }
+
+  for (int thread = 0; thread < clique_stacks.size(); ++thread) {
+    const CliqueStack& st = *clique_stacks[thread];
+    printf("\tClique stack %2d: %8.2f MB, peak %8.2f MB, %d on heap\n", thread,
+           st.Capacity() * 8 / 1e6, st.Peak() * 8 / 1e6, st.HeapAllocations());
+  }
+
+  if (instrumentation >= instr_counters) {
+    printf("\n\t  %-22s %10s %6s %10s %10s\n", "Hardware counters", "cycles",
+           "IPC", "LLC miss", "dTLB miss");
+    for (int i = 0; i < tr_size; ++i)
+      PrintCounters(k_phase_names[i], &counters_phase[i * hc_size]);
+    for (int i = 0; i < t_size; ++i)
+      PrintCounters(k_kernel_names[i], &counters_dense_fact[i * hc_size]);
+  }
 
   if (times_dense_fact[t_dtrsm] + times_dense_fact[t_dsyrk] +
           times_dense_fact[t_dgemm] + times_dense_fact[t_fact] +
@@ -675,33 +955,382 @@ void Factorise::PrintTimes() const {
          times_dense_fact[t_convert] / time_factorise * 100);
 }
 
+void Factorise::PrintMemory() const {
+  static const char* names[mem_size] = {"Factor", "Cliques", "Workspaces",
+                                        "Dense temporaries"};
+
+  printf("\n\t%-20s %8s %8s\n", "Memory (MB)", "current", "peak");
+  for (int c = 0; c < mem_size; ++c) {
+    printf("\t%-20s %8.2f %8.2f\n", names[c], memory_current[c] / 1e6,
+           memory_peak[c] / 1e6);
+  }
+  printf("\t%-20s %8s %8.2f\n", "Total", "", memory_peak_total / 1e6);
+  if (factor_file_ptr) {
+    printf("\t%-20s %8.2f %8s (limit %.2f)\n", "Factor on file",
+           factor_file_ptr->Bytes() / 1e6, "", factor_memory_limit / 1e6);
+  }
+
+  // Analyse estimates the peak of the factor, frontal matrix and cliques in a
+  // serial factorisation, with all of them stored in packed format
+  if (S.MaxStorage() > 0) {
+    printf("\t%-20s %8s %8.2f (actual / predicted %.2f)\n", "Predicted", "",
+           S.MaxStorage() / 1e6, memory_peak_total / S.MaxStorage());
+  }
+}
+
+int Factorise::WriteTrace(const std::string& file_name) const {
+  // Write the trace in the Chrome trace event format, which can be opened in
+  // chrome://tracing or in Perfetto. Each phase of a supernode is a complete
+  // event on the row of its thread, with times in microseconds.
+
+  FILE* file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    printf("WriteTrace: cannot open %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool first = true;
+  for (int thread = 0; thread < thread_times.size(); ++thread) {
+    fprintf(file,
+            "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+            first ? "" : ",\n", thread, thread);
+    first = false;
+
+    for (const TraceEvent& event : thread_times[thread].trace) {
+      const int sn_size = S.SnStart(event.sn + 1) - S.SnStart(event.sn);
+      const int ldf = S.Ptr(event.sn + 1) - S.Ptr(event.sn);
+      fprintf(file,
+              ",\n{\"name\": \"%s\", \"cat\": \"supernode\", "
+              "\"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, "
+              "\"dur\": %.3f, \"args\": {\"sn\": %d, \"front\": %d, "
+              "\"sn_size\": %d}}",
+              k_phase_names[event.phase], thread, event.start * 1e6,
+              (event.end - event.start) * 1e6, event.sn, ldf, sn_size);
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0) {
+    printf("WriteTrace: error writing %s\n", file_name.c_str());
+    return ret_generic;
+  }
+  return ret_ok;
+}
+
+int Factorise::ProcessSerial() {
+  // Process all supernodes in postorder, using only thread 0.
+
+  Clock clock_sn;
+  for (int sn = 0; sn < S.Sn(); ++sn) {
+    clock_sn.start();
+    const int status = ProcessSupernode(sn, 0);
+    time_per_Sn[sn] = clock_sn.stop();
+    if (status) return status;
+  }
+  return ret_ok;
+}
+
+int Factorise::ProcessLayer0() {
+  // Process the independent subtrees of layer0 in parallel, using the threads
+  // of the pool. Then, process the supernodes above layer0 serially.
+  // Subtrees are sorted in decreasing order of cost, so each thread takes the
+  // most expensive subtree not yet processed.
+
+  const std::vector<int>& layer0 = S.Layer0();
+  const std::vector<int>& layer0_start = S.Layer0Start();
+
+  std::atomic<int> next_subtree{0};
+  std::atomic<int> status{ret_ok};
+
+  pool->ParallelFor(pool->Threads(), [&](int) {
+    const int thread = pool->ThreadId();
+    Clock clock_sn;
+    while (status == ret_ok) {
+      const int i = next_subtree++;
+      if (i >= (int)layer0.size()) break;
+
+      // supernodes of the subtree are processed in postorder
+      for (int sn = layer0_start[i]; sn <= layer0[i]; ++sn) {
+        clock_sn.start();
+        const int sn_status = ProcessSupernode(sn, thread);
+        time_per_Sn[sn] = clock_sn.stop();
+        if (sn_status) {
+          status = sn_status;
+          break;
+        }
+      }
+    }
+  });
+  if (status) return status;
+
+  std::vector<bool> in_layer0(S.Sn(), false);
+  for (int i = 0; i < layer0.size(); ++i) {
+    for (int sn = layer0_start[i]; sn <= layer0[i]; ++sn) in_layer0[sn] = true;
+  }
+
+  // supernodes above layer0 are processed serially
+  Clock clock_sn;
+  for (int sn = 0; sn < S.Sn(); ++sn) {
+    if (in_layer0[sn]) continue;
+    clock_sn.start();
+    const int sn_status = ProcessSupernode(sn, 0);
+    time_per_Sn[sn] = clock_sn.stop();
+    if (sn_status) return sn_status;
+  }
+
+  return ret_ok;
+}
+
+int Factorise::ProcessTasks() {
+  // Process the supernodes as tasks of the scheduler.
+  // A supernode becomes ready when all its children have been processed. The
+  // thread that processes the last child of a supernode spawns the task of the
+  // parent in its own deque, so that the parent likely finds the Schur
+  // complements of the children in cache. Idle threads steal ready tasks.
+
+  const int sn_count = S.Sn();
+
+  // number of children of each supernode not yet processed
+  std::unique_ptr<std::atomic<int>[]> children_left(
+      new std::atomic<int>[sn_count]);
+  for (int sn = 0; sn < sn_count; ++sn) children_left[sn] = 0;
+  for (int sn = 0; sn < sn_count; ++sn) {
+    if (S.SnParent()[sn] != -1) ++children_left[S.SnParent()[sn]];
+  }
+
+  std::atomic<int> tasks_left{sn_count};
+  std::atomic<int> status{ret_ok};
+
+  std::function<void(int)> process_sn = [&](int sn) {
+    // after an error, the remaining supernodes are skipped, but the tree is
+    // still traversed, so that tasks_left reaches zero
+    if (status == ret_ok) {
+      Clock clock_sn;
+      clock_sn.start();
+      const int sn_status = ProcessSupernode(sn, pool->ThreadId());
+      time_per_Sn[sn] = clock_sn.stop();
+      if (sn_status) status = sn_status;
+    }
+
+    const int parent = S.SnParent()[sn];
+    if (parent != -1 && --children_left[parent] == 0) {
+      pool->Spawn([&process_sn, parent] { process_sn(parent); });
+    }
+    --tasks_left;
+  };
+
+  // Leaves are spawned in reverse postorder, so that thread 0 starts from the
+  // first leaf, while the other threads steal leaves from the other end of
+  // the tree.
+  for (int sn = sn_count - 1; sn >= 0; --sn) {
+    if (firstChildren[sn] == -1) {
+      pool->Spawn([&process_sn, sn] { process_sn(sn); });
+    }
+  }
+  pool->Wait(tasks_left);
+
+  return status;
+}
+
 int Factorise::Run(Numeric& Num) {
   Clock clock;
   clock.start();
 
+  if (!pool) pool = std::make_shared<Scheduler>(std::max(1, S.Threads()));
+
+  if (precision == PrecType::Single && S.Packed() != PackType::Full) {
+    printf("Single precision factorisation requires PackType::Full\n");
+    return ret_invalid_input;
+  }
+
   time_per_Sn.resize(S.Sn());
-  times_dense_fact.resize(times_ind::t_size);
-  clique_block_start.resize(S.Sn());
+  thread_times.assign(pool->Threads(), ThreadTimes());
 
-  Clock clock_sn;
+  // the dense kernels read the level of instrumentation when they are called
+  if (trace) instrumentation = std::max(instrumentation, instr_phase);
+  Instr_SetLevel(instrumentation);
+  trace_origin = Instr_Ticks();
+
+  if (factor_memory_limit > 0 && precision == PrecType::Single) {
+    printf("Out-of-core factorisation requires PrecType::Double\n");
+    return ret_invalid_input;
+  }
+
+  // the factor is stored in the precision chosen
+  if (precision == PrecType::Single) {
+    SnColumns.clear();
+    SnColumnsSingle.resize(S.Sn());
+    frontal_work.resize(pool->Threads());
+    clique_work.resize(pool->Threads());
+  } else {
+    SnColumns.resize(S.Sn());
+    SnColumnsSingle.clear();
+  }
+
+  // Thread 0 has a stack large enough to process the whole tree. The other
+  // threads mostly process subtrees of layer0. Cliques that do not fit are
+  // allocated on the heap.
+  clique_stacks.resize(pool->Threads());
+  for (int thread = 0; thread < pool->Threads(); ++thread) {
+    if (!clique_stacks[thread]) clique_stacks[thread].reset(new CliqueStack);
+    clique_stacks[thread]->Init(thread == 0 ? stack_size_tree
+                                            : stack_size_layer0);
+  }
+
+  // The memory of this factorisation is recorded from here, starting from the
+  // memory already held: the stacks of cliques, and the factor and workspaces
+  // kept from a previous factorisation.
+  Mem_Reset();
+  for (const auto& stack : clique_stacks)
+    Mem_Add(mem_cliques, stack->Capacity() * sizeof(double));
+  for (const std::vector<double>& col : SnColumns)
+    Mem_Add(mem_factor, col.capacity() * sizeof(double));
+  for (const std::vector<float>& col : SnColumnsSingle)
+    Mem_Add(mem_factor, col.capacity() * sizeof(float));
+  for (const std::vector<double>& work : frontal_work)
+    Mem_Add(mem_workspace, work.capacity() * sizeof(double));
+  for (const std::vector<float>& work : clique_work)
+    Mem_Add(mem_workspace, work.capacity() * sizeof(float));
+
+  // Out-of-core: a new file for each factorisation, since the previous factor
+  // may still be used by the solves
+  factor_file_ptr.reset();
+  if (factor_memory_limit > 0) {
+    std::vector<size_t> size(S.Sn());
+    for (int sn = 0; sn < S.Sn(); ++sn) size[sn] = SnColumnsSize(sn);
+    factor_file_ptr = std::make_shared<FactorFile>();
+    const int file_status =
+        factor_file_ptr->Open(factor_file, size, factor_memory_limit);
+    if (file_status) return file_status;
+  }
+
+  // Static pivoting: thresholds relative to the largest entry, and expected
+  // sign of the pivots in the permuted ordering
+  double max_val{};
+  for (double v : valA) max_val = std::max(max_val, std::abs(v));
+  const bool single = precision == PrecType::Single;
+  pivot_thresh = (single ? k_pivot_thresh_single : k_pivot_thresh) * max_val;
+  pivot_delta = (single ? k_pivot_delta_single : k_pivot_delta) * max_val;
+  sign_perm.assign(n, S.Type() == FactType::NormEq ? 1 : 0);
+  if (pivot_sign.size() == n) {
+    for (int i = 0; i < n; ++i) sign_perm[i] = pivot_sign[S.Perm()[i]];
+  }
+  reg_perm.assign(n, 0.0);
 
   int status{};
-  for (int sn = 0; sn < S.Sn(); ++sn) {
-    clock_sn.start();
-    status = ProcessSupernode(sn);
-    time_per_Sn[sn] = clock_sn.stop();
-    if (status) break;
+  switch (sched) {
+    case SchedType::Serial:
+      status = ProcessSerial();
+      break;
+    case SchedType::Layer0:
+      status = ProcessLayer0();
+      break;
+    case SchedType::Tasks:
+      status = ProcessTasks();
+      break;
+  }
+
+  // wait for the last columns to be written
+  if (factor_file_ptr) {
+    const int file_status = factor_file_ptr->Finish();
+    if (!status) status = file_status;
   }
 
   time_total = clock.stop();
 
+  // sum the times of all threads
+  time_prepare = 0.0;
+  time_assemble_original = 0.0;
+  time_assemble_children_F = 0.0;
+  time_assemble_children_C = 0.0;
+  time_factorise = 0.0;
+  times_dense_fact.assign(t_size, 0.0);
+  counters_phase.assign(tr_size * hc_size, 0.0);
+  counters_dense_fact.assign(t_size * hc_size, 0.0);
+  for (const ThreadTimes& t : thread_times) {
+    time_prepare += t.prepare;
+    time_assemble_original += t.assemble_original;
+    time_assemble_children_F += t.assemble_children_F;
+    time_assemble_children_C += t.assemble_children_C;
+    time_factorise += t.factorise;
+    for (int i = 0; i < t_size; ++i) times_dense_fact[i] += t.dense_fact[i];
+    for (int i = 0; i < tr_size * hc_size; ++i)
+      counters_phase[i] += t.phase_counters[i];
+    for (int i = 0; i < t_size * hc_size; ++i)
+      counters_dense_fact[i] += t.dense_counters[i];
+  }
+
+  memory_current.resize(mem_size);
+  memory_peak.resize(mem_size);
+  for (int c = 0; c < mem_size; ++c) {
+    memory_current[c] = Mem_Current(c);
+    memory_peak[c] = Mem_Peak(c);
+  }
+  memory_peak_total = Mem_TotalPeak();
+
   PrintTimes();
+  PrintMemory();
 
   if (status) return status;
 
+  // perturbations of the pivots, in the original ordering
+  pivot_reg.assign(n, 0.0);
+  n_perturbed = 0;
+  for (int i = 0; i < n; ++i) {
+    pivot_reg[S.Perm()[i]] = reg_perm[i];
+    if (reg_perm[i] != 0.0) ++n_perturbed;
+  }
+  if (n_perturbed > 0) {
+    printf("Static pivoting: %d pivots perturbed\n", n_perturbed);
+  }
+
   // move factorisation to numerical object
   Num.SnColumns = std::move(SnColumns);
+  Num.SnColumnsSingle = std::move(SnColumnsSingle);
   Num.S = &S;
+  Num.factor_file_ptr = factor_file_ptr;
+
+  // the solves use iterative refinement, and need the matrix, if the factor is
+  // in single precision or if some pivots were perturbed
+  if (precision == PrecType::Single || n_perturbed > 0) {
+    std::vector<double> val(nzA);
+    for (int el = 0; el < nzA; ++el) val[el] = valA[originA[el]];
+    Num.SetMatrix(ptrA, rowsA, std::move(val));
+  } else {
+    Num.SetMatrix({}, {}, {});
+  }
+
+  Num.pool = pool;
+  Num.SetLowRank({}, 0);
+  Num.PrepareWorkspace(1);
+  Num.PrepareParallel();
 
   return ret_ok;
-}
\ No newline at end of file
+}
+
+int Factorise::Refactorise(const std::vector<double>& valA_input,
+                           Numeric& Num) {
+  // Factorise a matrix with the same pattern as the one given to the
+  // constructor, with new values valA_input in the original ordering.
+  // The storage of the factor in Num is reused.
+
+  if (valA_input.size() != valA.size()) {
+    printf(
+        "Values provided to Refactorise have size incompatible with matrix.\n");
+    return ret_invalid_input;
+  }
+
+  std::copy(valA_input.begin(), valA_input.end(), valA.begin());
+
+  // take back the storage of the factor
+  if (Num.S == &S && Num.SnColumns.size() == S.Sn()) {
+    SnColumns = std::move(Num.SnColumns);
+  }
+  if (Num.S == &S && Num.SnColumnsSingle.size() == S.Sn()) {
+    SnColumnsSingle = std::move(Num.SnColumnsSingle);
+  }
+
+  return Run(Num);
+}
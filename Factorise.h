@@ -3,17 +3,113 @@
 
 #include "Auxiliary.h"
 #include "Blas_declaration.h"
+#include "CliqueStack.h"
 #include "DenseFact_declaration.h"
+#include "FactorFile.h"
+#include "Instrument.h"
+#include "Memory.h"
 #include "Numeric.h"
+#include "Scheduler.h"
 #include "Symbolic.h"
 
 #include <cmath>
+#include <memory>
+#include <string>
+
+// How the supernodes of the elimination tree are scheduled:
+// - Serial: all supernodes are processed in postorder by one thread.
+// - Layer0: the subtrees of layer0 are processed in parallel, then the
+//   remaining supernodes are processed serially.
+// - Tasks: each supernode is a task, that becomes ready when all its children
+//   have been processed. Ready tasks are executed by the threads of the
+//   scheduler, using work stealing.
+enum class SchedType { Serial, Layer0, Tasks };
+
+// How the Schur contributions of the children are assembled:
+// - TwoPass: the columns that belong to frontal are assembled before the
+//   partial factorisation, the others are assembled into clique after it, so
+//   that clique need not be initialized to zero.
+// - SinglePass: each child is assembled into frontal and clique at once, before
+//   the partial factorisation. clique is initialized to zero and the dense
+//   kernels add the Schur complement to it.
+enum class AssemblyType { TwoPass, SinglePass };
+
+// Precision of the factor:
+// - Double: the dense kernels and the factor use double precision.
+// - Single: frontal matrices are assembled in double precision, then they are
+//   factorised with the single precision kernels and the factor is stored in
+//   single precision. Numeric::Solve uses iterative refinement in double
+//   precision. Only available with PackType::Full.
+enum class PrecType { Double, Single };
+
+// parameters for node parallelism:
+// fronts with ldf * ldf * sn_size at least k_par_node_ops use the parallel
+// dense kernels
+const double k_par_node_ops = 5e7;
+
+// parameters for static pivoting, relative to the largest entry of the matrix:
+// pivots smaller than k_pivot_thresh are replaced by +-k_pivot_delta.
+// Single precision factorisations use larger values.
+const double k_pivot_thresh = 1e-12;
+const double k_pivot_delta = 1e-8;
+const double k_pivot_thresh_single = 1e-5;
+const double k_pivot_delta_single = 1e-3;
+
+// Phases of the processing of a supernode, recorded in the trace
+enum trace_phase {
+  tr_prepare,
+  tr_assemble_original,
+  tr_assemble_children_F,
+  tr_factorise,
+  tr_assemble_children_C,
+  tr_size
+};
+
+// Phase of a supernode, with start and end in seconds from the start of the
+// factorisation
+struct TraceEvent {
+  int sn;
+  trace_phase phase;
+  double start;
+  double end;
+};
+
+// Start of a phase: ticks and hardware counters of the thread
+struct PhaseStart {
+  uint64_t ticks{};
+  uint64_t counts[hc_size]{};
+};
+
+// Times of the factorisation, accumulated separately by each thread
+struct ThreadTimes {
+  double prepare{};
+  double assemble_original{};
+  double assemble_children_F{};
+  double assemble_children_C{};
+  double factorise{};
+  std::vector<double> dense_fact = std::vector<double>(t_size, 0.0);
+
+  // hardware counters of each phase and of each dense kernel, stored as
+  // counters[ind * hc_size + c], if measured
+  std::vector<double> phase_counters =
+      std::vector<double>(tr_size * hc_size, 0.0);
+  std::vector<double> dense_counters =
+      std::vector<double>(t_size * hc_size, 0.0);
+
+  // phases processed by the thread, if tracing
+  std::vector<TraceEvent> trace{};
+};
 
 class Factorise {
  public:
-  // matrix to factorise
+  // matrix to factorise, permuted and with sorted columns.
+  // Values are kept in the original ordering in valA. Entry el of the permuted
+  // matrix has value valA[originA[el]] and goes into position frontalA[el] of
+  // the frontal matrix of its supernode.
   std::vector<int> rowsA{};
   std::vector<int> ptrA{};
+  std::vector<int> originA{};
+  std::vector<int> frontalA{};
   std::vector<double> valA{};
   int n{};
   int nzA{};
@@ -30,14 +126,67 @@ class Factorise {
 
   // columns of L, stored as dense supernodes
   std::vector<std::vector<double>> SnColumns{};
+  std::vector<std::vector<float>> SnColumnsSingle{};
+
+  // file where the columns of L are written, for the out-of-core factorisation
+  std::shared_ptr<FactorFile> factor_file_ptr{};
+
+  // workspaces of each thread for the single precision factorisation: frontal
+  // matrix, assembled in double precision, and Schur complement
+  std::vector<std::vector<double>> frontal_work{};
+  std::vector<std::vector<float>> clique_work{};
 
-  std::vector<std::vector<int>> clique_block_start{};
+  // start of each block of columns of the cliques, for the hybrid formats.
+  // The blocks of the clique of sn start in positions clique_block_ptr[sn] to
+  // clique_block_ptr[sn+1]-1, the last one being the size of the clique.
+  std::vector<int> clique_block_start{};
+  std::vector<int> clique_block_ptr{};
+
+  // number of entries of each clique and thread that produced it
+  std::vector<int> clique_size{};
+  std::vector<int> clique_owner{};
+
+  // stacks of cliques, one for each thread
+  std::vector<std::unique_ptr<CliqueStack>> clique_stacks{};
+
+  // entries of the stack of cliques needed to process the whole tree and any
+  // subtree of layer0, in postorder
+  double stack_size_tree{};
+  double stack_size_layer0{};
+
+  // times accumulated by each thread
+  std::vector<ThreadTimes> thread_times{};
+
+  // ticks at the start of the factorisation, origin of the times of the trace
+  uint64_t trace_origin{};
+
+  // pool of threads used to process the tree
+  std::shared_ptr<Scheduler> pool{};
+
+  // expected sign and perturbation of each pivot, in the permuted ordering
+  std::vector<int> sign_perm{};
+  std::vector<double> reg_perm{};
+  double pivot_thresh{};
+  double pivot_delta{};
 
  public:
   void Permute(const std::vector<int>& iperm);
-  int ProcessSupernode(int sn);
+  size_t SnColumnsSize(int sn) const;
+  void AssembleChildFrontal(int sn, int child_sn, double* frontal) const;
+  void AssembleChildClique(int sn, int child_sn, double* clique) const;
+  int FactoriseSingle(int sn, int thread, const std::vector<double>& frontal,
+                      double* clique, double schur_beta,
+                      const DenseFact_piv* piv);
+  PhaseStart StartPhase() const;
+  double StopPhase(const PhaseStart& start, int sn, int thread,
+                   trace_phase phase);
+  int ProcessSupernode(int sn, int thread);
+  int ProcessSerial();
+  int ProcessLayer0();
+  int ProcessTasks();
   bool Check() const;
   void PrintTimes() const;
+  void PrintMemory() const;
 
  public:
   Factorise(const Symbolic& S_input, const std::vector<int>& rowsA_input,
@@ -46,8 +195,48 @@ class Factorise {
 
   int Run(Numeric& Num);
 
+  // factorise new values with the same pattern, reusing memory
+  int Refactorise(const std::vector<double>& valA_input, Numeric& Num);
+
+  SchedType sched = SchedType::Tasks;
+  AssemblyType assembly = AssemblyType::TwoPass;
+  PrecType precision = PrecType::Double;
+
+  // Static pivoting: pivots that are too small, or have the wrong sign, are
+  // perturbed and the factorisation continues, rather than failing.
+  // pivot_sign is the expected sign of each pivot (1 or -1, or 0 if unknown),
+  // in the original ordering. If empty, pivots are positive for NormEq and
+  // unknown for AugSys.
+  bool static_pivoting = true;
+  std::vector<int> pivot_sign{};
+
+  // perturbation added to each pivot, in the original ordering, and number of
+  // pivots perturbed
+  std::vector<double> pivot_reg{};
+  int n_perturbed{};
+
+  // Level of instrumentation: instr_off, instr_phase (times of the phases of
+  // each supernode), instr_kernel (times of the dense kernels as well) or
+  // instr_counters (hardware counters of the phases and kernels as well)
+  instr_level instrumentation = instr_phase;
+
+  // Record the start and end of each phase of each supernode, with the thread
+  // that processed it. The trace of the last factorisation is written by
+  // WriteTrace. Tracing needs at least instr_phase.
+  bool trace = false;
+  int WriteTrace(const std::string& file_name) const;
+
+  // Out-of-core factorisation: if factor_memory_limit is positive, the columns
+  // of each supernode are written to factor_file as soon as they are computed,
+  // and freed once written. At most factor_memory_limit bytes of columns wait
+  // to be written, and the solves read them back from the file. If factor_file
+  // is empty, a temporary file is used. Only with PrecType::Double.
+  double factor_memory_limit{};
+  std::string factor_file{};
+
   std::vector<double> time_per_Sn{};
 
+  // times of each phase, summed over all threads
   double time_prepare{};
   double time_assemble_original{};
   double time_assemble_children_F{};
@@ -55,6 +244,17 @@ class Factorise {
   double time_factorise{};
   double time_total{};
   std::vector<double> times_dense_fact;
+
+  // hardware counters of each phase and each dense kernel, summed over all
+  // threads, stored as counters[ind * hc_size + c]
+  std::vector<double> counters_phase;
+  std::vector<double> counters_dense_fact;
+
+  // bytes of each mem_category at the end of the factorisation and at their
+  // peak, and peak of the total
+  std::vector<double> memory_current;
+  std::vector<double> memory_peak;
+  double memory_peak_total{};
 };
 
 #endif
\ No newline at end of file
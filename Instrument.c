@@ -0,0 +1,165 @@
+#include "Instrument.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+int instr_level_current = instr_phase;
+double instr_tick = 1e-9;
+
+// Hardware counters of each thread, opened the first time they are read.
+// counter_state is 0 if not opened yet, 1 if open and -1 if not available.
+// The counters are read as a group from counter_leader; counter_slot is the
+// position of each counter in the group, or -1 if it could not be opened, and
+// counter_fd its file descriptor.
+static _Thread_local int counter_state = 0;
+static _Thread_local int counter_leader = -1;
+static _Thread_local int counter_slot[hc_size];
+static _Thread_local int counter_fd[hc_size];
+static _Thread_local int counter_open = 0;
+
+#ifdef __linux__
+// The counters of a thread are closed when it exits, through the destructor of
+// counter_key, which is set for the threads that opened them
+static pthread_key_t counter_key;
+static pthread_once_t counter_key_once = PTHREAD_ONCE_INIT;
+
+static void CloseCountersAtExit(void* unused) {
+  (void)unused;
+  Instr_CloseCounters();
+}
+static void CreateCounterKey(void) {
+  pthread_key_create(&counter_key, CloseCountersAtExit);
+}
+#endif
+
+// destination of the counters of the kernels
+static _Thread_local double* kernel_counters = NULL;
+
+static double MonotonicSeconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  // count the ticks of the time stamp counter in about 10 ms
+  const double s0 = MonotonicSeconds();
+  const uint64_t t0 = Instr_Ticks();
+  double s1 = s0;
+  while (s1 - s0 < 0.01) s1 = MonotonicSeconds();
+  const uint64_t t1 = Instr_Ticks();
+  if (t1 > t0) instr_tick = (s1 - s0) / (double)(t1 - t0);
+#elif defined(__aarch64__)
+  // the frequency of the virtual counter is given by the system
+  uint64_t freq;
+  __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+  if (freq > 0) instr_tick = 1.0 / (double)freq;
+#endif
+}
+
+static void OpenCounters(void) {
+  counter_state = -1;
+#ifdef __linux__
+  const uint32_t type[hc_size] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                  PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+  const uint64_t config[hc_size] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+  // cycles lead the group; the other counters are skipped if not supported
+  for (int c = 0; c < hc_size; ++c) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type[c];
+    attr.config = config[c];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    const int fd =
+        syscall(__NR_perf_event_open, &attr, 0, -1, counter_leader, 0);
+    counter_slot[c] = -1;
+    if (fd < 0) {
+      if (c == 0) return;
+      continue;
+    }
+    if (c == 0) counter_leader = fd;
+    counter_slot[c] = counter_open++;
+    counter_fd[c] = fd;
+  }
+  counter_state = 1;
+
+  pthread_once(&counter_key_once, CreateCounterKey);
+  pthread_setspecific(counter_key, &counter_state);
+#endif
+}
+
+void Instr_CloseCounters(void) {
+#ifdef __linux__
+  // the members of the group are closed before the leader
+  if (counter_state > 0) {
+    for (int c = hc_size - 1; c >= 0; --c) {
+      if (counter_slot[c] >= 0) close(counter_fd[c]);
+    }
+    pthread_setspecific(counter_key, NULL);
+  }
+#endif
+  counter_state = 0;
+  counter_leader = -1;
+  counter_open = 0;
+}
+
+int Instr_ReadCounters(uint64_t* counts) {
+  memset(counts, 0, hc_size * sizeof(uint64_t));
+  if (counter_state == 0) OpenCounters();
+  if (counter_state < 0) return 0;
+
+#ifdef __linux__
+  // number of counters, followed by their values
+  uint64_t buffer[1 + hc_size];
+  const ssize_t bytes = read(counter_leader, buffer, sizeof(buffer));
+  if (bytes < (ssize_t)sizeof(uint64_t)) return 0;
+  for (int c = 0; c < hc_size; ++c) {
+    if (counter_slot[c] >= 0) counts[c] = buffer[1 + counter_slot[c]];
+  }
+#endif
+  return 1;
+}
+
+void Instr_SetKernelCounters(double* counters) { kernel_counters = counters; }
+
+void Instr_KernelCountersStop(int ind, const uint64_t* start) {
+  if (!kernel_counters) return;
+  uint64_t counts[hc_size];
+  Instr_ReadCounters(counts);
+  for (int c = 0; c < hc_size; ++c)
+    kernel_counters[ind * hc_size + c] += counts[c] - start[c];
+}
+
+void Instr_SetLevel(int level) {
+  static int calibrated = 0;
+  if (!calibrated) {
+    Calibrate();
+    calibrated = 1;
+  }
+
+  if (level >= instr_counters) {
+    uint64_t counts[hc_size];
+    if (!Instr_ReadCounters(counts))
+      printf("Hardware counters are not available\n");
+  }
+
+  instr_level_current = level;
+}
@@ -0,0 +1,103 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instrumentation of the factorisation, with the level chosen at runtime:
+// - instr_off: nothing is timed.
+// - instr_phase: the phases of each supernode are timed.
+// - instr_kernel: the BLAS calls and dense kernels are timed as well.
+// - instr_counters: the hardware counters below are also measured for each
+//   phase and each kernel. They are read with perf_event on Linux, and are
+//   zero if not available.
+// Timers read a monotonic counter directly: the time stamp counter on x86 (it
+// is assumed to be invariant, as on any recent processor), the virtual counter
+// on ARM, CLOCK_MONOTONIC elsewhere. Ticks are converted to seconds with
+// instr_tick, measured by Instr_SetLevel the first time it is called.
+enum instr_level { instr_off, instr_phase, instr_kernel, instr_counters };
+
+// hardware counters, counted in user space for the calling thread
+enum instr_counter {
+  hc_cycles,
+  hc_instructions,
+  hc_llc_misses,
+  hc_dtlb_misses,
+  hc_size
+};
+
+extern int instr_level_current;
+extern double instr_tick;
+
+// Set the level of instrumentation of the following factorisations
+void Instr_SetLevel(int level);
+
+// Read the hardware counters of the calling thread into counts (hc_size
+// values). Return 1 if they are available; otherwise counts are zero.
+int Instr_ReadCounters(uint64_t* counts);
+
+// Close the hardware counters of the calling thread. This is done
+// automatically when a thread that opened them exits; they are opened again if
+// read afterwards.
+void Instr_CloseCounters(void);
+
+// The counters of the kernels called by this thread are added to
+// counters[ind * hc_size + c], where ind is the index in times_ind
+void Instr_SetKernelCounters(double* counters);
+void Instr_KernelCountersStop(int ind, const uint64_t* start);
+
+// Start of a kernel: ticks and hardware counters of the calling thread.
+// It is kept by the caller, so that a task executed while the kernel runs
+// cannot overwrite it.
+typedef struct {
+  uint64_t ticks;
+  uint64_t counts[hc_size];
+} instr_start;
+
+static inline uint64_t Instr_Ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+// seconds between two values of Instr_Ticks
+static inline double Instr_Seconds(uint64_t t0, uint64_t t1) {
+  return (double)(t1 - t0) * instr_tick;
+}
+
+// Start and stop the timer of a kernel, whose time is added to times[ind].
+// Nothing is measured below instr_kernel.
+static inline void Instr_KernelStart(instr_start* start) {
+  if (instr_level_current < instr_kernel) return;
+  if (instr_level_current >= instr_counters) Instr_ReadCounters(start->counts);
+  start->ticks = Instr_Ticks();
+}
+static inline void Instr_KernelStop(double* times, int ind,
+                                    const instr_start* start) {
+  if (instr_level_current < instr_kernel) return;
+  times[ind] += Instr_Seconds(start->ticks, Instr_Ticks());
+  if (instr_level_current >= instr_counters)
+    Instr_KernelCountersStop(ind, start->counts);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+#include "MatrixIO.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "Auxiliary.h"
+#include "Symbolic.h"
+
+// offsets of the arrays in the binary CSC format
+static size_t OffsetPtr() { return sizeof(CscHeader); }
+static size_t OffsetRows(int n) {
+  return OffsetPtr() + sizeof(int) * ((size_t)n + 1);
+}
+static size_t OffsetVal(int n, int nz) {
+  // values are aligned to 8 bytes
+  const size_t offset = OffsetRows(n) + sizeof(int) * (size_t)nz;
+  return (offset + 7) / 8 * 8;
+}
+
+int ReadMatrixMarket(const std::string& file_name, int& n,
+                     std::vector<int>& ptr, std::vector<int>& rows,
+                     std::vector<double>& val) {
+  std::ifstream file(file_name);
+  if (!file.is_open()) {
+    printf("ReadMatrixMarket: cannot open %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  // banner
+  std::string line;
+  std::getline(file, line);
+  std::string banner, object, format, field, symmetry;
+  std::istringstream(line) >> banner >> object >> format >> field >> symmetry;
+  if (banner != "%%MatrixMarket" || object != "matrix" ||
+      format != "coordinate" || field == "complex") {
+    printf("ReadMatrixMarket: unsupported format in %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+  const bool pattern = field == "pattern";
+  const bool symmetric = symmetry == "symmetric";
+
+  // skip comments
+  while (std::getline(file, line)) {
+    if (!line.empty() && line[0] != '%') break;
+  }
+
+  int m{};
+  long long entries{};
+  std::istringstream(line) >> m >> n >> entries;
+  if (m != n || n <= 0) {
+    printf("ReadMatrixMarket: matrix is not square\n");
+    return ret_invalid_input;
+  }
+  if (entries < 0) {
+    printf("ReadMatrixMarket: invalid number of entries\n");
+    return ret_invalid_input;
+  }
+
+  // read entries of the lower triangle in coordinate format
+  std::vector<int> coo_rows, coo_cols;
+  std::vector<double> coo_val;
+  coo_rows.reserve(entries);
+  coo_cols.reserve(entries);
+  coo_val.reserve(entries);
+  for (long long k = 0; k < entries; ++k) {
+    int i, j;
+    double v = 1.0;
+    if (!(file >> i >> j) || (!pattern && !(file >> v))) {
+      printf("ReadMatrixMarket: error reading entry %lld\n", k);
+      return ret_invalid_input;
+    }
+    if (i < 1 || i > m || j < 1 || j > n) {
+      printf("ReadMatrixMarket: index out of range in entry %lld\n", k);
+      return ret_invalid_input;
+    }
+    --i;
+    --j;
+
+    if (i < j) {
+      // upper triangle: symmetric matrices may store this one instead
+      if (!symmetric) continue;
+      std::swap(i, j);
+    }
+    coo_rows.push_back(i);
+    coo_cols.push_back(j);
+    coo_val.push_back(v);
+  }
+
+  // convert to CSC, storing rows by column in the transpose, so that the
+  // double transpose sorts the columns
+  const int nz = coo_rows.size();
+  std::vector<int> work(n, 0);
+  for (int k = 0; k < nz; ++k) ++work[coo_rows[k]];
+  std::vector<int> ptrT(n + 1);
+  Counts2Ptr(ptrT, work);
+  std::vector<int> rowsT(nz);
+  std::vector<double> valT(nz);
+  for (int k = 0; k < nz; ++k) {
+    const int pos = work[coo_rows[k]]++;
+    rowsT[pos] = coo_cols[k];
+    valT[pos] = coo_val[k];
+  }
+
+  ptr.resize(n + 1);
+  rows.resize(nz);
+  val.resize(nz);
+  Transpose(ptrT, rowsT, valT, ptr, rows, val);
+
+  return ret_ok;
+}
+
+int WriteBinaryCSC(const std::string& file_name, int n, int type,
+                   const std::vector<int>& ptr, const std::vector<int>& rows,
+                   const std::vector<double>& val) {
+  const int nz = ptr[n];
+
+  CscHeader header{};
+  std::memcpy(header.magic, "FACTCSC", 8);
+  header.version = k_csc_version;
+  header.type = type;
+  header.n = n;
+  header.nz = nz;
+
+  FILE* file = fopen(file_name.c_str(), "wb");
+  if (!file) {
+    printf("WriteBinaryCSC: cannot open %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  const size_t padding = OffsetVal(n, nz) - OffsetRows(n) - sizeof(int) * nz;
+  const char zeros[8]{};
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && fwrite(ptr.data(), sizeof(int), n + 1, file) == n + 1;
+  ok = ok && fwrite(rows.data(), sizeof(int), nz, file) == nz;
+  ok = ok && fwrite(zeros, 1, padding, file) == padding;
+  ok = ok && fwrite(val.data(), sizeof(double), nz, file) == nz;
+  fclose(file);
+
+  if (!ok) {
+    printf("WriteBinaryCSC: error writing %s\n", file_name.c_str());
+    return ret_generic;
+  }
+  return ret_ok;
+}
+
+MappedCSC::~MappedCSC() { Close(); }
+
+void MappedCSC::Close() {
+  if (data) munmap(data, size);
+  data = nullptr;
+  size = 0;
+  ptr = nullptr;
+  rows = nullptr;
+  val = nullptr;
+}
+
+int MappedCSC::Open(const std::string& file_name) {
+  Close();
+
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("MappedCSC: cannot open %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CscHeader)) {
+    printf("MappedCSC: invalid file %s\n", file_name.c_str());
+    close(fd);
+    return ret_invalid_input;
+  }
+  size = st.st_size;
+
+  data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    data = nullptr;
+    printf("MappedCSC: mmap failed for %s\n", file_name.c_str());
+    return ret_generic;
+  }
+
+  const CscHeader* header = static_cast<const CscHeader*>(data);
+  const char* bytes = static_cast<const char*>(data);
+
+  if (std::memcmp(header->magic, "FACTCSC", 8) != 0 ||
+      header->version != k_csc_version || header->type < -1 ||
+      header->type > (int)FactType::AugSys || header->n < 0 || header->nz < 0 ||
+      size < OffsetVal(header->n, header->nz) + sizeof(double) * header->nz) {
+    printf("MappedCSC: invalid file %s\n", file_name.c_str());
+    Close();
+    return ret_invalid_input;
+  }
+
+  // the column pointers must be monotonic from 0 to nz, and the row indices
+  // in range, before they are handed out
+  const int n_file = header->n;
+  const int nz_file = header->nz;
+  const int* ptr_file = reinterpret_cast<const int*>(bytes + OffsetPtr());
+  const int* rows_file =
+      reinterpret_cast<const int*>(bytes + OffsetRows(n_file));
+  bool valid = ptr_file[0] == 0 && ptr_file[n_file] == nz_file;
+  for (int col = 0; valid && col < n_file; ++col)
+    valid = ptr_file[col] <= ptr_file[col + 1];
+  for (int el = 0; valid && el < nz_file; ++el)
+    valid = rows_file[el] >= 0 && rows_file[el] < n_file;
+  if (!valid) {
+    printf("MappedCSC: invalid matrix in %s\n", file_name.c_str());
+    Close();
+    return ret_invalid_input;
+  }
+
+  n = n_file;
+  nz = nz_file;
+  type = header->type;
+  ptr = ptr_file;
+  rows = rows_file;
+  val = reinterpret_cast<const double*>(bytes + OffsetVal(n, nz));
+
+  return ret_ok;
+}
+
+int ReadMatrix(const std::string& file_name, int& n, int& type,
+               std::vector<int>& ptr, std::vector<int>& rows,
+               std::vector<double>& val) {
+  const size_t len = file_name.size();
+  if (len < 4 || file_name.compare(len - 4, 4, ".csc") != 0) {
+    return ReadMatrixMarket(file_name, n, ptr, rows, val);
+  }
+
+  // Analyse and Factorise take the matrix as vectors, so the mapped arrays are
+  // copied once
+  MappedCSC csc;
+  const int status = csc.Open(file_name);
+  if (status) return status;
+
+  n = csc.n;
+  if (csc.type >= 0) type = csc.type;
+  ptr.assign(csc.ptr, csc.ptr + n + 1);
+  rows.assign(csc.rows, csc.rows + csc.nz);
+  val.assign(csc.val, csc.val + csc.nz);
+
+  return ret_ok;
+}
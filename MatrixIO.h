@@ -0,0 +1,70 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <string>
+#include <vector>
+
+#include "DenseFact_declaration.h"
+
+// Input and output of symmetric matrices, stored as the lower triangle in CSC
+// format, with sorted columns.
+//
+// Two formats are supported:
+// - Matrix Market coordinate format (real, integer or pattern; symmetric or
+//   general). Only the lower triangle is kept; entries of the upper triangle
+//   of a general matrix are ignored.
+// - Binary CSC format, written by WriteBinaryCSC. The file contains a header,
+//   followed by ptr (n+1 ints), rows (nz ints) and val (nz doubles). The arrays
+//   are aligned, so that the file can be memory-mapped and used without copies.
+
+// header of the binary CSC format
+struct CscHeader {
+  char magic[8];  // "FACTCSC"
+  int version;
+  int type;  // FactType of the matrix, or -1 if unknown
+  int n;
+  int nz;
+};
+
+const int k_csc_version = 1;
+
+int ReadMatrixMarket(const std::string& file_name, int& n,
+                     std::vector<int>& ptr, std::vector<int>& rows,
+                     std::vector<double>& val);
+
+int WriteBinaryCSC(const std::string& file_name, int n, int type,
+                   const std::vector<int>& ptr, const std::vector<int>& rows,
+                   const std::vector<double>& val);
+
+// Binary CSC file, memory-mapped in read-only mode.
+// ptr, rows and val point directly into the mapped file.
+class MappedCSC {
+  void* data = nullptr;
+  size_t size{};
+
+ public:
+  int n{};
+  int nz{};
+  int type = -1;
+  const int* ptr = nullptr;
+  const int* rows = nullptr;
+  const double* val = nullptr;
+
+  MappedCSC() = default;
+  ~MappedCSC();
+  MappedCSC(const MappedCSC&) = delete;
+  MappedCSC& operator=(const MappedCSC&) = delete;
+
+  int Open(const std::string& file_name);
+  void Close();
+};
+
+// Read a matrix from file, choosing the format from the extension:
+// .csc for binary CSC, anything else for Matrix Market.
+// type is set to the type stored in the file, if any, otherwise it is left
+// unchanged.
+int ReadMatrix(const std::string& file_name, int& n, int& type,
+               std::vector<int>& ptr, std::vector<int>& rows,
+               std::vector<double>& val);
+
+#endif
@@ -0,0 +1,70 @@
+#include "Memory.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static _Atomic int64_t current[mem_size];
+static _Atomic int64_t peak[mem_size];
+static _Atomic int64_t total_current;
+static _Atomic int64_t total_peak;
+
+// Blocks of Mem_Malloc start with a header with their size and category.
+// The header is 16 bytes, so that the alignment of malloc is kept.
+typedef union {
+  struct {
+    size_t bytes;
+    int category;
+  } info;
+  char align[16];
+} MemHeader;
+
+static void UpdatePeak(_Atomic int64_t* p, int64_t value) {
+  int64_t old = atomic_load(p);
+  while (value > old && !atomic_compare_exchange_weak(p, &old, value)) {
+  }
+}
+
+void Mem_Reset(void) {
+  for (int c = 0; c < mem_size; ++c) {
+    atomic_store(&current[c], 0);
+    atomic_store(&peak[c], 0);
+  }
+  atomic_store(&total_current, 0);
+  atomic_store(&total_peak, 0);
+}
+
+void Mem_Add(int category, int64_t bytes) {
+  const int64_t now = atomic_fetch_add(&current[category], bytes) + bytes;
+  const int64_t total = atomic_fetch_add(&total_current, bytes) + bytes;
+  if (bytes > 0) {
+    UpdatePeak(&peak[category], now);
+    UpdatePeak(&total_peak, total);
+  }
+}
+
+int64_t Mem_Current(int category) { return atomic_load(&current[category]); }
+int64_t Mem_Peak(int category) { return atomic_load(&peak[category]); }
+int64_t Mem_TotalPeak(void) { return atomic_load(&total_peak); }
+
+void* Mem_Malloc(int category, size_t bytes) {
+  MemHeader* header = malloc(sizeof(MemHeader) + bytes);
+  if (!header) return NULL;
+  header->info.bytes = bytes;
+  header->info.category = category;
+  Mem_Add(category, bytes);
+  return header + 1;
+}
+
+void* Mem_Calloc(int category, size_t count, size_t size) {
+  void* ptr = Mem_Malloc(category, count * size);
+  if (ptr) memset(ptr, 0, count * size);
+  return ptr;
+}
+
+void Mem_Free(void* ptr) {
+  if (!ptr) return;
+  MemHeader* header = (MemHeader*)ptr - 1;
+  Mem_Add(header->info.category, -(int64_t)header->info.bytes);
+  free(header);
+}
@@ -0,0 +1,44 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Accounting of the memory allocated by the factorisation, by category.
+// The current and peak bytes of each category, and of their total, are updated
+// atomically, so that any thread can allocate and free. The peak of the total
+// is tracked separately, because the categories need not reach their peaks at
+// the same time.
+enum mem_category {
+  mem_factor,     // columns of L
+  mem_cliques,    // stacks of cliques and cliques allocated on the heap
+  mem_workspace,  // workspaces of the threads
+  mem_dense,      // temporaries of the dense kernels
+  mem_size
+};
+
+// Set the current and peak bytes of all categories to zero
+void Mem_Reset(void);
+
+// Record an allocation (bytes > 0) or a deallocation (bytes < 0)
+void Mem_Add(int category, int64_t bytes);
+
+int64_t Mem_Current(int category);
+int64_t Mem_Peak(int category);
+int64_t Mem_TotalPeak(void);
+
+// malloc, calloc and free that record the memory in the given category.
+// Memory from Mem_Malloc and Mem_Calloc must be freed with Mem_Free.
+void* Mem_Malloc(int category, size_t bytes);
+void* Mem_Calloc(int category, size_t count, size_t size);
+void Mem_Free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
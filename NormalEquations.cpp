@@ -0,0 +1,136 @@
+#include "NormalEquations.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "Auxiliary.h"
+#include "DenseFact_declaration.h"
+
+int NormalEquations::Setup(int m_input, const std::vector<int>& ptr,
+                           const std::vector<int>& rows,
+                           const std::vector<double>& val,
+                           const std::vector<int>& dropped_cols) {
+  m = m_input;
+  n = ptr.size() - 1;
+  if (m <= 0 || n < 0 || rows.size() < ptr[n] || val.size() < ptr[n]) {
+    printf("NormalEquations: invalid matrix\n");
+    return ret_invalid_input;
+  }
+
+  ptrA = ptr;
+  rowsA.assign(rows.begin(), rows.begin() + ptr[n]);
+  valA.assign(val.begin(), val.begin() + ptr[n]);
+
+  std::vector<bool> dropped(n, false);
+  for (int col : dropped_cols) {
+    if (col < 0 || col >= n) {
+      printf("NormalEquations: invalid dropped column %d\n", col);
+      return ret_invalid_input;
+    }
+    dropped[col] = true;
+  }
+
+  // row-wise copy of the columns that are kept
+  std::vector<int> work_count(m, 0);
+  for (int col = 0; col < n; ++col) {
+    if (dropped[col]) continue;
+    for (int el = ptrA[col]; el < ptrA[col + 1]; ++el) ++work_count[rowsA[el]];
+  }
+  ptrAT.resize(m + 1);
+  Counts2Ptr(ptrAT, work_count);
+  colsAT.resize(ptrAT[m]);
+  valAT.resize(ptrAT[m]);
+  for (int col = 0; col < n; ++col) {
+    if (dropped[col]) continue;
+    for (int el = ptrA[col]; el < ptrA[col + 1]; ++el) {
+      const int pos = work_count[rowsA[el]]++;
+      colsAT[pos] = col;
+      valAT[pos] = valA[el];
+    }
+  }
+
+  // Pattern of the lower triangle of M.
+  // Column j contains row i >= j if rows i and j of A share a column.
+  std::vector<int> mark(m, -1);
+  ptrM.assign(1, 0);
+  rowsM.clear();
+  for (int j = 0; j < m; ++j) {
+    const int start = rowsM.size();
+    rowsM.push_back(j);
+    mark[j] = j;
+    for (int elT = ptrAT[j]; elT < ptrAT[j + 1]; ++elT) {
+      const int col = colsAT[elT];
+      for (int el = ptrA[col]; el < ptrA[col + 1]; ++el) {
+        const int i = rowsA[el];
+        if (i < j || mark[i] == j) continue;
+        mark[i] = j;
+        rowsM.push_back(i);
+      }
+    }
+    std::sort(rowsM.begin() + start, rowsM.end());
+    ptrM.push_back(rowsM.size());
+  }
+
+  if (!pool) {
+    pool = std::make_shared<Scheduler>(
+        std::max(1u, std::thread::hardware_concurrency()));
+  }
+  work.assign(pool->Threads(), std::vector<double>(m, 0.0));
+
+  return ret_ok;
+}
+
+int NormalEquations::Fill(const std::vector<double>& theta, double reg,
+                          std::vector<double>& valM) {
+  if (!theta.empty() && theta.size() != n) {
+    printf("NormalEquations: theta has size %d instead of %d\n",
+           (int)theta.size(), n);
+    return ret_invalid_input;
+  }
+  if (work.size() < pool->Threads()) {
+    printf("NormalEquations: Setup was not called\n");
+    return ret_invalid_input;
+  }
+
+  valM.resize(ptrM[m]);
+
+  // Columns are taken in chunks by the threads as they become free, because
+  // the cost of the columns varies a lot.
+  std::atomic<int> next_chunk{0};
+  pool->ParallelFor(pool->Threads(), [&](int) {
+    std::vector<double>& w = work[pool->ThreadId()];
+    while (true) {
+      const int first = k_normeq_chunk * next_chunk++;
+      if (first >= m) break;
+      const int last = std::min(m, first + k_normeq_chunk);
+
+      for (int j = first; j < last; ++j) {
+        // scatter theta(col) * A(j,col) * A(:,col) for each col in row j of A
+        for (int elT = ptrAT[j]; elT < ptrAT[j + 1]; ++elT) {
+          const int col = colsAT[elT];
+          const double coeff =
+              (theta.empty() ? 1.0 : theta[col]) * valAT[elT];
+          for (int el = ptrA[col]; el < ptrA[col + 1]; ++el) {
+            const int i = rowsA[el];
+            if (i >= j) w[i] += coeff * valA[el];
+          }
+        }
+
+        // gather into the pattern of column j; the diagonal is first
+        w[j] += reg;
+        for (int el = ptrM[j]; el < ptrM[j + 1]; ++el) {
+          valM[el] = w[rowsM[el]];
+          w[rowsM[el]] = 0.0;
+        }
+      }
+    }
+  });
+
+  return ret_ok;
+}
+
+const std::vector<int>& NormalEquations::Ptr() const { return ptrM; }
+const std::vector<int>& NormalEquations::Rows() const { return rowsM; }
+int NormalEquations::Size() const { return m; }
+int NormalEquations::Nz() const { return ptrM.empty() ? 0 : ptrM.back(); }
@@ -0,0 +1,61 @@
+#ifndef NORMAL_EQUATIONS_H
+#define NORMAL_EQUATIONS_H
+
+#include <memory>
+#include <vector>
+
+#include "Scheduler.h"
+
+// number of columns of M that a thread takes at a time in Fill
+const int k_normeq_chunk = 64;
+
+// Builder of the normal equations M = A * Theta * A^T + reg * I, for a sparse
+// m x n matrix A and a diagonal Theta that changes at every iteration of the
+// interior point method.
+// Setup computes once the pattern of the lower triangle of M, with sorted
+// columns and the diagonal always present. Fill then computes only the values,
+// in parallel by columns of M, directly in the lower triangular CSC format used
+// by Analyse and Factorise.
+// The pattern is structural: entries that cancel numerically are kept, so that
+// it does not depend on Theta.
+class NormalEquations {
+  int m{};
+  int n{};
+
+  // A by columns, and by rows without the dropped columns
+  std::vector<int> ptrA{};
+  std::vector<int> rowsA{};
+  std::vector<double> valA{};
+  std::vector<int> ptrAT{};
+  std::vector<int> colsAT{};
+  std::vector<double> valAT{};
+
+  // pattern of the lower triangle of M
+  std::vector<int> ptrM{};
+  std::vector<int> rowsM{};
+
+  // dense accumulator of a column of M, one for each thread
+  std::vector<std::vector<double>> work{};
+
+ public:
+  // pool of threads used by Fill; created by Setup if not given
+  std::shared_ptr<Scheduler> pool{};
+
+  // Input A (with m rows) in CSC format. The columns in dropped_cols are left
+  // out of M, e.g. the dense columns that are handled separately.
+  int Setup(int m_input, const std::vector<int>& ptr,
+            const std::vector<int>& rows, const std::vector<double>& val,
+            const std::vector<int>& dropped_cols = {});
+
+  // Compute the values of M for the given theta (of size n, or empty for the
+  // identity) and regularization, in the pattern given by Ptr and Rows.
+  int Fill(const std::vector<double>& theta, double reg,
+           std::vector<double>& valM);
+
+  const std::vector<int>& Ptr() const;
+  const std::vector<int>& Rows() const;
+  int Size() const;
+  int Nz() const;
+};
+
+#endif
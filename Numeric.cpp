@@ -1,26 +1,388 @@
 #include "Numeric.h"
 
+#include <algorithm>
+#include <cmath>
+
+void Numeric::LsolveSn(int sn, double* x, double* y, double* x_up,
+                       int up_start) const {
+  // Forward solve with supernode sn.
+  // Updates to rows smaller than up_start are applied to x. Updates to the
+  // other rows are accumulated in x_up, to be applied later.
+  // Blas calls: dtrsv_, dtpsv_, dgemv_
+
+  // variables for BLAS calls
+  const char LL = 'L';
+  const char NN = 'N';
+  const char TT = 'T';
+  const char UU = 'U';
+  const int i_one = 1;
+  const double d_one = 1.0;
+  const double d_zero = 0.0;
+
+  // unit diagonal for augmented system only
+  const char DD = S->Type() == FactType::NormEq ? 'N' : 'U';
+
+  // leading size of supernode
+  const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+
+  // number of columns in the supernode
+  const int sn_size = S->SnStart(sn + 1) - S->SnStart(sn);
+
+  // first colums of the supernode
+  const int sn_start = S->SnStart(sn);
+
+  // index to access S->rows for this supernode
+  const int start_row = S->Ptr(sn);
+
+  if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
+    // supernode columns in hybrid-blocked format
+
+    const int nb = S->BlockSize();
+
+    // number of blocks of columns
+    const int n_blocks = (sn_size - 1) / nb + 1;
+
+    // index to access SnColumns[sn]
+    int SnCol_ind{};
+
+    // go through blocks of columns for this supernode
+    for (int j = 0; j < n_blocks; ++j) {
+      // number of columns in the block
+      const int jb = std::min(nb, sn_size - nb * j);
+
+      // number of entries in diagonal part
+      const int diag_entries = jb * (jb + 1) / 2;
+
+      // index to access vector x
+      const int x_start = sn_start + nb * j;
+
+      dtpsv_(&UU, &TT, &DD, &jb, &SnData(sn)[SnCol_ind], &x[x_start],
+             &i_one);
+      SnCol_ind += diag_entries;
+
+      const int gemv_space = ldSn - nb * j - jb;
+      dgemv_(&TT, &jb, &gemv_space, &d_one, &SnData(sn)[SnCol_ind], &jb,
+             &x[x_start], &i_one, &d_zero, y, &i_one);
+      SnCol_ind += jb * gemv_space;
+
+      // scatter solution of gemv
+      for (int i = 0; i < gemv_space; ++i) {
+        const int row = S->Rows(start_row + nb * j + jb + i);
+        if (row < up_start)
+          x[row] -= y[i];
+        else
+          x_up[row] += y[i];
+      }
+    }
+
+  } else {
+    // supernode columns in full format
+
+    // size of clique of supernode
+    const int clique_size = ldSn - sn_size;
+
+    dtrsv_(&LL, &NN, &DD, &sn_size, SnData(sn), &ldSn, &x[sn_start],
+           &i_one);
+
+    dgemv_(&NN, &clique_size, &sn_size, &d_one, &SnData(sn)[sn_size], &ldSn,
+           &x[sn_start], &i_one, &d_zero, y, &i_one);
+
+    // scatter solution of gemv
+    for (int i = 0; i < clique_size; ++i) {
+      const int row = S->Rows(start_row + sn_size + i);
+      if (row < up_start)
+        x[row] -= y[i];
+      else
+        x_up[row] += y[i];
+    }
+  }
+}
+
+void Numeric::LtsolveSn(int sn, double* x, double* y) const {
+  // Backward solve with supernode sn.
+  // Blas calls: dgemv_, dtrsv_, dtpsv_
+
+  // variables for BLAS calls
+  const char LL = 'L';
+  const char NN = 'N';
+  const char TT = 'T';
+  const char UU = 'U';
+  const int i_one = 1;
+  const double d_m_one = -1.0;
+  const double d_one = 1.0;
+
+  // unit diagonal for augmented system only
+  const char DD = S->Type() == FactType::NormEq ? 'N' : 'U';
+
+  // leading size of supernode
+  const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+
+  // number of columns in the supernode
+  const int sn_size = S->SnStart(sn + 1) - S->SnStart(sn);
+
+  // first colums of the supernode
+  const int sn_start = S->SnStart(sn);
+
+  // index to access S->rows for this supernode
+  const int start_row = S->Ptr(sn);
+
+  if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
+    // supernode columns in hybrid-blocked format
+
+    const int nb = S->BlockSize();
+
+    // number of blocks of columns
+    const int n_blocks = (sn_size - 1) / nb + 1;
+
+    // index to access SnColumns[sn]
+    // initialized with the total number of entries of SnColumns[sn]
+    int SnCol_ind = ldSn * sn_size - sn_size * (sn_size - 1) / 2;
+
+    // go through blocks of columns for this supernode in reverse order
+    for (int j = n_blocks - 1; j >= 0; --j) {
+      // number of columns in the block
+      const int jb = std::min(nb, sn_size - nb * j);
+
+      // number of entries in diagonal part
+      const int diag_entries = jb * (jb + 1) / 2;
+
+      // index to access vector x
+      const int x_start = sn_start + nb * j;
+
+      const int gemv_space = ldSn - nb * j - jb;
+
+      // scatter entries into y
+      for (int i = 0; i < gemv_space; ++i) {
+        const int row = S->Rows(start_row + nb * j + jb + i);
+        y[i] = x[row];
+      }
+
+      SnCol_ind -= jb * gemv_space;
+      dgemv_(&NN, &jb, &gemv_space, &d_m_one, &SnData(sn)[SnCol_ind], &jb,
+             y, &i_one, &d_one, &x[x_start], &i_one);
+
+      SnCol_ind -= diag_entries;
+      dtpsv_(&UU, &NN, &DD, &jb, &SnData(sn)[SnCol_ind], &x[x_start],
+             &i_one);
+    }
+  } else {
+    // supernode columns in full format
+
+    // size of clique of supernode
+    const int clique_size = ldSn - sn_size;
+
+    // scatter entries into y
+    for (int i = 0; i < clique_size; ++i) {
+      const int row = S->Rows(start_row + sn_size + i);
+      y[i] = x[row];
+    }
+
+    dgemv_(&TT, &clique_size, &sn_size, &d_m_one, &SnData(sn)[sn_size],
+           &ldSn, y, &i_one, &d_one, &x[sn_start], &i_one);
+
+    dtrsv_(&LL, &TT, &DD, &sn_size, SnData(sn), &ldSn, &x[sn_start],
+           &i_one);
+  }
+}
+
+bool Numeric::SolveInParallel() const {
+  return pool && pool->Threads() > 1 && S->Layer0().size() > 1;
+}
+
 void Numeric::Lsolve(std::vector<double>& x) const {
   // Forward solve.
-  // Blas calls: dtrsv_, dgemv_
+  // If possible, the subtrees of layer0 are solved in parallel. Each thread
+  // accumulates the updates to the rows outside of its subtrees in its own
+  // buffer. These rows belong to the cliques of the roots of the subtrees and
+  // the buffers are added to x before the supernodes above layer0 are solved.
+
+  PrepareWorkspace(1);
+  const int n = S->Size();
+
+  if (!SolveInParallel()) {
+    for (int sn = 0; sn < S->Sn(); ++sn) {
+      LsolveSn(sn, x.data(), work_y.data(), nullptr, n);
+    }
+    return;
+  }
+
+  const std::vector<int>& layer0 = S->Layer0();
+  const std::vector<int>& layer0_start = S->Layer0Start();
+
+  pool->ParallelFor(layer0.size(), [&](int i) {
+    const int thread = pool->ThreadId();
+    double* y = &work_par_y[(size_t)thread * S->LargestFront()];
+    double* x_up = &work_par_up[(size_t)thread * n];
+
+    // rows from this one are outside of the subtree
+    const int up_start = S->SnStart(layer0[i] + 1);
+
+    for (int sn = layer0_start[i]; sn <= layer0[i]; ++sn) {
+      LsolveSn(sn, x.data(), y, x_up, up_start);
+    }
+    subtree_thread[i] = thread;
+  });
+
+  // apply the updates accumulated by the threads, and clear the buffers
+  for (int i = 0; i < layer0.size(); ++i) {
+    double* x_up = &work_par_up[(size_t)subtree_thread[i] * n];
+    const int root = layer0[i];
+    const int root_size = S->SnStart(root + 1) - S->SnStart(root);
+    for (int el = S->Ptr(root) + root_size; el < S->Ptr(root + 1); ++el) {
+      const int row = S->Rows(el);
+      x[row] -= x_up[row];
+      x_up[row] = 0.0;
+    }
+  }
+
+  // supernodes above layer0
+  for (int sn : sn_above_layer0) {
+    LsolveSn(sn, x.data(), work_y.data(), nullptr, n);
+  }
+}
+
+void Numeric::Ltsolve(std::vector<double>& x) const {
+  // Backward solve.
+  // If possible, the supernodes above layer0 are solved first, and then the
+  // subtrees of layer0 are solved in parallel. Each subtree only writes to its
+  // own columns, so there are no conflicts.
+
+  PrepareWorkspace(1);
+
+  if (!SolveInParallel()) {
+    for (int sn = S->Sn() - 1; sn >= 0; --sn) {
+      LtsolveSn(sn, x.data(), work_y.data());
+    }
+    return;
+  }
+
+  // supernodes above layer0, in reverse order
+  for (int i = sn_above_layer0.size() - 1; i >= 0; --i) {
+    LtsolveSn(sn_above_layer0[i], x.data(), work_y.data());
+  }
+
+  const std::vector<int>& layer0 = S->Layer0();
+  const std::vector<int>& layer0_start = S->Layer0Start();
+
+  pool->ParallelFor(layer0.size(), [&](int i) {
+    double* y = &work_par_y[(size_t)pool->ThreadId() * S->LargestFront()];
+    for (int sn = layer0[i]; sn >= layer0_start[i]; --sn) {
+      LtsolveSn(sn, x.data(), y);
+    }
+  });
+}
+
+void Numeric::Dsolve(std::vector<double>& x) const {
+  // Diagonal solve
+
+  // Dsolve performed only for augmented system
+  if (S->Type() == FactType::NormEq) return;
+
+  if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
+    // supernode columns in hybrid-blocked format
+
+    const int nb = S->BlockSize();
+
+    for (int sn = 0; sn < S->Sn(); ++sn) {
+      // leading size of supernode
+      const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+
+      // number of columns in the supernode
+      const int sn_size = S->SnStart(sn + 1) - S->SnStart(sn);
+
+      // first colums of the supernode
+      const int sn_start = S->SnStart(sn);
+
+      // index to access S->rows for this supernode
+      const int start_row = S->Ptr(sn);
+
+      // number of blocks of columns
+      const int n_blocks = (sn_size - 1) / nb + 1;
+
+      // index to access diagonal part of block
+      int diag_start{};
+
+      // go through blocks of columns for this supernode
+      for (int j = 0; j < n_blocks; ++j) {
+        // number of columns in the block
+        const int jb = std::min(nb, sn_size - nb * j);
+
+        // go through columns of block
+        for (int col = 0; col < jb; ++col) {
+          const double d =
+              SnData(sn)[diag_start + (col + 1) * (col + 2) / 2 - 1];
+          x[sn_start + nb * j + col] /= d;
+        }
+
+        // move diag_start forward by number of diagonal entries in block
+        diag_start += jb * (jb + 1) / 2;
+
+        // move diag_start forward by number of sub-diagonal entries in block
+        diag_start += (ldSn - nb * j - jb) * jb;
+      }
+    }
+  } else {
+    // supernode columns in full format
+
+    for (int sn = 0; sn < S->Sn(); ++sn) {
+      // leading size of supernode
+      const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+
+      for (int col = S->SnStart(sn); col < S->SnStart(sn + 1); ++col) {
+        // relative index of column within supernode
+        const int j = col - S->SnStart(sn);
+
+        // diagonal entry of column j
+        const double d = SnData(sn)[j + j * ldSn];
+
+        x[col] /= d;
+      }
+    }
+  }
+}
+
+void Numeric::Solve(std::vector<double>& x) const {
+  Solve(x, 1);
+}
+
+// Unpack the upper packed diagonal block of size jb into a full matrix, with
+// leading dimension jb
+static void UnpackDiagBlock(const double* packed, int jb, double* full) {
+  int pos{};
+  for (int col = 0; col < jb; ++col) {
+    for (int row = 0; row <= col; ++row) full[row + jb * col] = packed[pos++];
+  }
+}
+
+void Numeric::Lsolve(std::vector<double>& x, int nrhs) const {
+  // Forward solve with multiple right hand sides.
+  // Blas calls: dtrsm_, dgemm_
 
   // variables for BLAS calls
   const char LL = 'L';
   const char NN = 'N';
   const char TT = 'T';
   const char UU = 'U';
-  const int i_one = 1;
   const double d_one = 1.0;
   const double d_zero = 0.0;
 
   // unit diagonal for augmented system only
   const char DD = S->Type() == FactType::NormEq ? 'N' : 'U';
 
+  const int n = S->Size();
+
+  // temporary space for gemm
+  PrepareWorkspace(nrhs);
+  double* y = work_y.data();
+
   if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
     // supernode columns in hybrid-blocked format
 
     const int nb = S->BlockSize();
 
+    // full copy of diagonal blocks
+    double* diag = work_diag.data();
+
     for (int sn = 0; sn < S->Sn(); ++sn) {
       // leading size of supernode
       const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
@@ -51,22 +413,25 @@ void Numeric::Lsolve(std::vector<double>& x) const {
         // index to access vector x
         const int x_start = sn_start + nb * j;
 
-        dtpsv_(&UU, &TT, &DD, &jb, &SnColumns[sn][SnCol_ind], &x[x_start],
-               &i_one);
+        UnpackDiagBlock(&SnData(sn)[SnCol_ind], jb, diag);
+        dtrsm_(&LL, &UU, &TT, &DD, &jb, &nrhs, &d_one, diag, &jb,
+               &x[x_start], &n);
         SnCol_ind += diag_entries;
 
-        // temporary space for gemv
-        const int gemv_space = ldSn - nb * j - jb;
-        std::vector<double> y(gemv_space);
+        const int gemm_space = ldSn - nb * j - jb;
+        if (gemm_space == 0) continue;
 
-        dgemv_(&TT, &jb, &gemv_space, &d_one, &SnColumns[sn][SnCol_ind], &jb,
-               &x[x_start], &i_one, &d_zero, y.data(), &i_one);
-        SnCol_ind += jb * gemv_space;
+        dgemm_(&TT, &NN, &gemm_space, &nrhs, &jb, &d_one,
+               &SnData(sn)[SnCol_ind], &jb, &x[x_start], &n, &d_zero,
+               y, &gemm_space);
+        SnCol_ind += jb * gemm_space;
 
-        // scatter solution of gemv
-        for (int i = 0; i < gemv_space; ++i) {
-          const int row = S->Rows(start_row + nb * j + jb + i);
-          x[row] -= y[i];
+        // scatter solution of gemm
+        for (int r = 0; r < nrhs; ++r) {
+          for (int i = 0; i < gemm_space; ++i) {
+            const int row = S->Rows(start_row + nb * j + jb + i);
+            x[row + n * r] -= y[i + gemm_space * r];
+          }
         }
       }
     }
@@ -90,46 +455,54 @@ void Numeric::Lsolve(std::vector<double>& x) const {
       // index to access S->rows for this supernode
       const int start_row = S->Ptr(sn);
 
-      dtrsv_(&LL, &NN, &DD, &sn_size, SnColumns[sn].data(), &ldSn, &x[sn_start],
-             &i_one);
-
-      // temporary space for gemv
-      std::vector<double> y(clique_size);
+      dtrsm_(&LL, &LL, &NN, &DD, &sn_size, &nrhs, &d_one, SnData(sn),
+             &ldSn, &x[sn_start], &n);
+      if (clique_size == 0) continue;
 
-      dgemv_(&NN, &clique_size, &sn_size, &d_one, &SnColumns[sn][sn_size],
-             &ldSn, &x[sn_start], &i_one, &d_zero, y.data(), &i_one);
+      dgemm_(&NN, &NN, &clique_size, &nrhs, &sn_size, &d_one,
+             &SnData(sn)[sn_size], &ldSn, &x[sn_start], &n, &d_zero,
+             y, &clique_size);
 
-      // scatter solution of gemv
-      for (int i = 0; i < clique_size; ++i) {
-        const int row = S->Rows(start_row + sn_size + i);
-        x[row] -= y[i];
+      // scatter solution of gemm
+      for (int r = 0; r < nrhs; ++r) {
+        for (int i = 0; i < clique_size; ++i) {
+          const int row = S->Rows(start_row + sn_size + i);
+          x[row + n * r] -= y[i + clique_size * r];
+        }
       }
     }
   }
 }
 
-void Numeric::Ltsolve(std::vector<double>& x) const {
-  // Backward solve.
-  // Blas calls: dgemv_, dtrsv_
+void Numeric::Ltsolve(std::vector<double>& x, int nrhs) const {
+  // Backward solve with multiple right hand sides.
+  // Blas calls: dgemm_, dtrsm_
 
   // variables for BLAS calls
   const char LL = 'L';
   const char NN = 'N';
   const char TT = 'T';
   const char UU = 'U';
-  const int i_one = 1;
   const double d_m_one = -1.0;
   const double d_one = 1.0;
-  const double d_zero = 0.0;
 
   // unit diagonal for augmented system only
   const char DD = S->Type() == FactType::NormEq ? 'N' : 'U';
 
+  const int n = S->Size();
+
+  // temporary space for gemm
+  PrepareWorkspace(nrhs);
+  double* y = work_y.data();
+
   if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
     // supernode columns in hybrid-blocked format
 
     const int nb = S->BlockSize();
 
+    // full copy of diagonal blocks
+    double* diag = work_diag.data();
+
     // go through the sn in reverse order
     for (int sn = S->Sn() - 1; sn >= 0; --sn) {
       // leading size of supernode
@@ -162,23 +535,27 @@ void Numeric::Ltsolve(std::vector<double>& x) const {
         // index to access vector x
         const int x_start = sn_start + nb * j;
 
-        // temporary space for gemv
-        const int gemv_space = ldSn - nb * j - jb;
-        std::vector<double> y(gemv_space);
-
-        // scatter entries into y
-        for (int i = 0; i < gemv_space; ++i) {
-          const int row = S->Rows(start_row + nb * j + jb + i);
-          y[i] = x[row];
+        const int gemm_space = ldSn - nb * j - jb;
+
+        if (gemm_space > 0) {
+          // scatter entries into y
+          for (int r = 0; r < nrhs; ++r) {
+            for (int i = 0; i < gemm_space; ++i) {
+              const int row = S->Rows(start_row + nb * j + jb + i);
+              y[i + gemm_space * r] = x[row + n * r];
+            }
+          }
+
+          SnCol_ind -= jb * gemm_space;
+          dgemm_(&NN, &NN, &jb, &nrhs, &gemm_space, &d_m_one,
+                 &SnData(sn)[SnCol_ind], &jb, y, &gemm_space, &d_one,
+                 &x[x_start], &n);
         }
 
-        SnCol_ind -= jb * gemv_space;
-        dgemv_(&NN, &jb, &gemv_space, &d_m_one, &SnColumns[sn][SnCol_ind], &jb,
-               y.data(), &i_one, &d_one, &x[x_start], &i_one);
-
         SnCol_ind -= diag_entries;
-        dtpsv_(&UU, &NN, &DD, &jb, &SnColumns[sn][SnCol_ind], &x[x_start],
-               &i_one);
+        UnpackDiagBlock(&SnData(sn)[SnCol_ind], jb, diag);
+        dtrsm_(&LL, &UU, &NN, &DD, &jb, &nrhs, &d_one, diag, &jb,
+               &x[x_start], &n);
       }
     }
   } else {
@@ -201,30 +578,34 @@ void Numeric::Ltsolve(std::vector<double>& x) const {
       // index to access S->rows for this supernode
       const int start_row = S->Ptr(sn);
 
-      // temporary space for gemv
-      std::vector<double> y(clique_size);
+      if (clique_size > 0) {
+        // scatter entries into y
+        for (int r = 0; r < nrhs; ++r) {
+          for (int i = 0; i < clique_size; ++i) {
+            const int row = S->Rows(start_row + sn_size + i);
+            y[i + clique_size * r] = x[row + n * r];
+          }
+        }
 
-      // scatter entries into y
-      for (int i = 0; i < clique_size; ++i) {
-        const int row = S->Rows(start_row + sn_size + i);
-        y[i] = x[row];
+        dgemm_(&TT, &NN, &sn_size, &nrhs, &clique_size, &d_m_one,
+               &SnData(sn)[sn_size], &ldSn, y, &clique_size, &d_one,
+               &x[sn_start], &n);
       }
 
-      dgemv_(&TT, &clique_size, &sn_size, &d_m_one, &SnColumns[sn][sn_size],
-             &ldSn, y.data(), &i_one, &d_one, &x[sn_start], &i_one);
-
-      dtrsv_(&LL, &TT, &DD, &sn_size, SnColumns[sn].data(), &ldSn, &x[sn_start],
-             &i_one);
+      dtrsm_(&LL, &LL, &TT, &DD, &sn_size, &nrhs, &d_one, SnData(sn),
+             &ldSn, &x[sn_start], &n);
     }
   }
 }
 
-void Numeric::Dsolve(std::vector<double>& x) const {
-  // Diagonal solve
+void Numeric::Dsolve(std::vector<double>& x, int nrhs) const {
+  // Diagonal solve with multiple right hand sides
 
   // Dsolve performed only for augmented system
   if (S->Type() == FactType::NormEq) return;
 
+  const int n = S->Size();
+
   if (S->Packed() == PackType::Hybrid || S->Packed() == PackType::Hybrid2) {
     // supernode columns in hybrid-blocked format
 
@@ -240,9 +621,6 @@ void Numeric::Dsolve(std::vector<double>& x) const {
       // first colums of the supernode
       const int sn_start = S->SnStart(sn);
 
-      // index to access S->rows for this supernode
-      const int start_row = S->Ptr(sn);
-
       // number of blocks of columns
       const int n_blocks = (sn_size - 1) / nb + 1;
 
@@ -257,8 +635,9 @@ void Numeric::Dsolve(std::vector<double>& x) const {
         // go through columns of block
         for (int col = 0; col < jb; ++col) {
           const double d =
-              SnColumns[sn][diag_start + (col + 1) * (col + 2) / 2 - 1];
-          x[sn_start + nb * j + col] /= d;
+              SnData(sn)[diag_start + (col + 1) * (col + 2) / 2 - 1];
+          for (int r = 0; r < nrhs; ++r)
+            x[sn_start + nb * j + col + n * r] /= d;
         }
 
         // move diag_start forward by number of diagonal entries in block
@@ -280,18 +659,356 @@ void Numeric::Dsolve(std::vector<double>& x) const {
         const int j = col - S->SnStart(sn);
 
         // diagonal entry of column j
-        const double d = SnColumns[sn][j + j * ldSn];
+        const double d = SnData(sn)[j + j * ldSn];
 
-        x[col] /= d;
+        for (int r = 0; r < nrhs; ++r) x[col + n * r] /= d;
       }
     }
   }
 }
 
-void Numeric::Solve(std::vector<double>& x) const {
-  PermuteVector(x, S->Perm());
-  Lsolve(x);
-  Dsolve(x);
-  Ltsolve(x);
-  PermuteVector(x, S->Iperm());
+void Numeric::Solve(std::vector<double>& x, int nrhs) const {
+  // Full solve, using the workspace of the object.
+  // The permutation is applied when copying x into and out of the workspace,
+  // so no other memory is allocated.
+
+  const int n = S->Size();
+  PrepareWorkspace(nrhs);
+
+  for (int r = 0; r < nrhs; ++r) {
+    for (int i = 0; i < n; ++i) work_x[i + n * r] = x[S->Perm()[i] + n * r];
+  }
+
+  SolveMatrix(nrhs);
+  if (lowrank_k > 0) ApplyLowRank(nrhs);
+
+  for (int r = 0; r < nrhs; ++r) {
+    for (int i = 0; i < n; ++i) x[S->Perm()[i] + n * r] = work_x[i + n * r];
+  }
+}
+
+void Numeric::SolveMatrix(int nrhs) const {
+  // Solve with the factorised matrix, in the permuted ordering, with the right
+  // hand sides in work_x.
+  if (valA.empty()) {
+    SolveFactor(work_x, nrhs);
+  } else {
+    Refine(nrhs);
+  }
+}
+
+void Numeric::ApplyLowRank(int nrhs) const {
+  // Given y = M^-1 b in work_x, compute
+  //  x = y - W * C^-1 * U^T * y
+  // Blas calls: dgemm_, dtrsm_
+
+  // variables for BLAS calls
+  const char LL = 'L';
+  const char NN = 'N';
+  const char TT = 'T';
+  const double d_one = 1.0;
+  const double d_m_one = -1.0;
+  const double d_zero = 0.0;
+
+  const int n = S->Size();
+  const int k = lowrank_k;
+  double* z = work_lowrank.data();
+
+  dgemm_(&TT, &NN, &k, &nrhs, &n, &d_one, lowrank_U.data(), &n, work_x.data(),
+         &n, &d_zero, z, &k);
+  dtrsm_(&LL, &LL, &NN, &NN, &k, &nrhs, &d_one, lowrank_C.data(), &k, z, &k);
+  dtrsm_(&LL, &LL, &TT, &NN, &k, &nrhs, &d_one, lowrank_C.data(), &k, z, &k);
+  dgemm_(&NN, &NN, &n, &nrhs, &k, &d_m_one, lowrank_W.data(), &n, z, &k,
+         &d_one, work_x.data(), &n);
+}
+
+int Numeric::SetLowRank(const std::vector<double>& U, int k) {
+  // variables for BLAS calls
+  const char NN = 'N';
+  const char TT = 'T';
+  const double d_one = 1.0;
+
+  const int n = S->Size();
+
+  lowrank_k = 0;
+  lowrank_U.clear();
+  lowrank_W.clear();
+  lowrank_C.clear();
+  if (k <= 0) return ret_ok;
+  if (U.size() < (size_t)n * k) {
+    printf("Numeric::SetLowRank: invalid input\n");
+    return ret_invalid_input;
+  }
+
+  // permute U
+  lowrank_U.resize((size_t)n * k);
+  for (int r = 0; r < k; ++r) {
+    for (int i = 0; i < n; ++i)
+      lowrank_U[i + (size_t)n * r] = U[S->Perm()[i] + (size_t)n * r];
+  }
+
+  // W = M^-1 U
+  PrepareWorkspace(k);
+  std::copy_n(lowrank_U.begin(), (size_t)n * k, work_x.begin());
+  SolveMatrix(k);
+  lowrank_W.assign(work_x.begin(), work_x.begin() + (size_t)n * k);
+
+  // C = I + U^T W, and its Cholesky factorisation
+  lowrank_C.assign((size_t)k * k, 0.0);
+  for (int i = 0; i < k; ++i) lowrank_C[i + k * i] = 1.0;
+  dgemm_(&TT, &NN, &k, &k, &n, &d_one, lowrank_U.data(), &n, lowrank_W.data(),
+         &n, &d_one, lowrank_C.data(), &k);
+  if (DenseFact_fduf('L', k, lowrank_C.data(), k, nullptr, 0)) {
+    printf("Numeric::SetLowRank: correction is not positive definite\n");
+    lowrank_U.clear();
+    lowrank_W.clear();
+    lowrank_C.clear();
+    return ret_invalid_pivot;
+  }
+
+  lowrank_k = k;
+  return ret_ok;
+}
+
+void Numeric::SolveFactor(std::vector<double>& x, int nrhs) const {
+  // Solve with the factor, in the permuted ordering
+
+  if (!SnColumnsSingle.empty()) {
+    // the solves are done in single precision, on a copy of x
+    FlushToZero ftz;
+    const size_t size = (size_t)S->Size() * nrhs;
+    std::copy_n(x.begin(), size, work_single_x.begin());
+    SolveSingle(work_single_x.data(), nrhs);
+    std::copy_n(work_single_x.begin(), size, x.begin());
+    return;
+  }
+
+  if (nrhs == 1) {
+    Lsolve(x);
+    Dsolve(x);
+    Ltsolve(x);
+  } else {
+    Lsolve(x, nrhs);
+    Dsolve(x, nrhs);
+    Ltsolve(x, nrhs);
+  }
+}
+
+void Numeric::SolveSingle(float* x, int nrhs) const {
+  // Forward, diagonal and backward solves with the single precision factor,
+  // stored in full format, with multiple right hand sides.
+  // Blas calls: strsm_, sgemm_
+
+  // variables for BLAS calls
+  const char LL = 'L';
+  const char NN = 'N';
+  const char TT = 'T';
+  const float s_one = 1.0f;
+  const float s_m_one = -1.0f;
+  const float s_zero = 0.0f;
+
+  // unit diagonal for augmented system only
+  const char DD = S->Type() == FactType::NormEq ? 'N' : 'U';
+
+  const int n = S->Size();
+  float* y = work_single_y.data();
+
+  // forward solve
+  for (int sn = 0; sn < S->Sn(); ++sn) {
+    const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+    const int sn_size = S->SnStart(sn + 1) - S->SnStart(sn);
+    const int sn_start = S->SnStart(sn);
+    const int clique_size = ldSn - sn_size;
+    const int start_row = S->Ptr(sn);
+    const float* L = SnColumnsSingle[sn].data();
+
+    strsm_(&LL, &LL, &NN, &DD, &sn_size, &nrhs, &s_one, L, &ldSn, &x[sn_start],
+           &n);
+    if (clique_size == 0) continue;
+
+    sgemm_(&NN, &NN, &clique_size, &nrhs, &sn_size, &s_one, &L[sn_size], &ldSn,
+           &x[sn_start], &n, &s_zero, y, &clique_size);
+
+    // scatter solution of gemm
+    for (int r = 0; r < nrhs; ++r) {
+      for (int i = 0; i < clique_size; ++i) {
+        const int row = S->Rows(start_row + sn_size + i);
+        x[row + n * r] -= y[i + clique_size * r];
+      }
+    }
+  }
+
+  // diagonal solve, for augmented system only
+  if (S->Type() == FactType::AugSys) {
+    for (int sn = 0; sn < S->Sn(); ++sn) {
+      const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+      for (int col = S->SnStart(sn); col < S->SnStart(sn + 1); ++col) {
+        const int j = col - S->SnStart(sn);
+        const float d = SnColumnsSingle[sn][j + j * ldSn];
+        for (int r = 0; r < nrhs; ++r) x[col + n * r] /= d;
+      }
+    }
+  }
+
+  // backward solve
+  for (int sn = S->Sn() - 1; sn >= 0; --sn) {
+    const int ldSn = S->Ptr(sn + 1) - S->Ptr(sn);
+    const int sn_size = S->SnStart(sn + 1) - S->SnStart(sn);
+    const int sn_start = S->SnStart(sn);
+    const int clique_size = ldSn - sn_size;
+    const int start_row = S->Ptr(sn);
+    const float* L = SnColumnsSingle[sn].data();
+
+    if (clique_size > 0) {
+      // gather entries into y
+      for (int r = 0; r < nrhs; ++r) {
+        for (int i = 0; i < clique_size; ++i) {
+          const int row = S->Rows(start_row + sn_size + i);
+          y[i + clique_size * r] = x[row + n * r];
+        }
+      }
+
+      sgemm_(&TT, &NN, &sn_size, &nrhs, &clique_size, &s_m_one, &L[sn_size],
+             &ldSn, y, &clique_size, &s_one, &x[sn_start], &n);
+    }
+
+    strsm_(&LL, &LL, &TT, &DD, &sn_size, &nrhs, &s_one, L, &ldSn, &x[sn_start],
+           &n);
+  }
+}
+
+void Numeric::Refine(int nrhs) const {
+  // Solve with iterative refinement, in the permuted ordering.
+  // On input work_x contains the right hand sides, on output the solutions.
+  // The residuals are computed in double precision with the matrix A, and the
+  // corrections are obtained by solving with the factor.
+
+  const int n = S->Size();
+  const size_t size = (size_t)n * nrhs;
+
+  std::copy_n(work_x.begin(), size, work_b.begin());
+  SolveFactor(work_x, nrhs);
+
+  // best solution found, in work_best, and its residual
+  double best = INFINITY;
+  refine_iter = 0;
+  while (true) {
+    // residual r = b - A * x, using the lower triangle of A
+    std::copy_n(work_b.begin(), size, work_r.begin());
+    for (int r = 0; r < nrhs; ++r) {
+      const double* x = &work_x[(size_t)n * r];
+      double* res = &work_r[(size_t)n * r];
+      for (int j = 0; j < n; ++j) {
+        for (int el = ptrA[j]; el < ptrA[j + 1]; ++el) {
+          const int i = rowsA[el];
+          res[i] -= valA[el] * x[j];
+          if (i != j) res[j] -= valA[el] * x[i];
+        }
+      }
+    }
+
+    // largest scaled residual of the right hand sides
+    refine_residual = 0.0;
+    for (int r = 0; r < nrhs; ++r) {
+      double norm_r{}, norm_x{}, norm_b{};
+      for (size_t i = (size_t)n * r; i < (size_t)n * (r + 1); ++i) {
+        norm_r = std::max(norm_r, std::abs(work_r[i]));
+        norm_x = std::max(norm_x, std::abs(work_x[i]));
+        norm_b = std::max(norm_b, std::abs(work_b[i]));
+      }
+      const double scale = normA * norm_x + norm_b;
+      if (scale > 0.0) {
+        refine_residual = std::max(refine_residual, norm_r / scale);
+      }
+    }
+
+    // a step that does not reduce the residual enough ends the refinement,
+    // and its solution is discarded if it is worse than the best one
+    if (refine_residual >= refine_contraction * best) {
+      if (refine_residual > best) {
+        std::copy_n(work_best.begin(), size, work_x.begin());
+        refine_residual = best;
+      }
+      break;
+    }
+    if (refine_residual <= refine_tol || refine_iter >= refine_max_iter) break;
+    best = refine_residual;
+    std::copy_n(work_x.begin(), size, work_best.begin());
+
+    // correction
+    SolveFactor(work_r, nrhs);
+    for (size_t i = 0; i < size; ++i) work_x[i] += work_r[i];
+    ++refine_iter;
+  }
+}
+
+void Numeric::SetMatrix(const std::vector<int>& ptr,
+                        const std::vector<int>& rows,
+                        std::vector<double>&& val) {
+  // Store the matrix for iterative refinement and compute its infinity norm.
+  // Empty vectors disable refinement.
+
+  ptrA = ptr;
+  rowsA = rows;
+  valA = std::move(val);
+
+  normA = 0.0;
+  if (valA.empty()) return;
+
+  const int n = ptrA.size() - 1;
+  std::vector<double> row_sum(n, 0.0);
+  for (int j = 0; j < n; ++j) {
+    for (int el = ptrA[j]; el < ptrA[j + 1]; ++el) {
+      const int i = rowsA[el];
+      row_sum[i] += std::abs(valA[el]);
+      if (i != j) row_sum[j] += std::abs(valA[el]);
+    }
+  }
+  for (double v : row_sum) normA = std::max(normA, v);
+}
+
+void Numeric::PrepareParallel() {
+  // Find the supernodes above layer0 and allocate the buffers for the parallel
+  // solves. The buffers of the updates are initialized to zero here and are
+  // cleared by each solve after use.
+
+  if (!SolveInParallel()) return;
+
+  std::vector<bool> in_layer0(S->Sn(), false);
+  for (int i = 0; i < S->Layer0().size(); ++i) {
+    for (int sn = S->Layer0Start()[i]; sn <= S->Layer0()[i]; ++sn) {
+      in_layer0[sn] = true;
+    }
+  }
+  sn_above_layer0.clear();
+  for (int sn = 0; sn < S->Sn(); ++sn) {
+    if (!in_layer0[sn]) sn_above_layer0.push_back(sn);
+  }
+
+  subtree_thread.assign(S->Layer0().size(), 0);
+  work_par_y.assign((size_t)pool->Threads() * S->LargestFront(), 0.0);
+  work_par_up.assign((size_t)pool->Threads() * S->Size(), 0.0);
+}
+
+void Numeric::PrepareWorkspace(int nrhs) const {
+  // Memory is allocated only the first time that a given number of right hand
+  // sides is used.
+  const size_t size_x = (size_t)S->Size() * nrhs;
+  const size_t size_y = (size_t)S->LargestFront() * nrhs;
+  const size_t size_diag = (size_t)S->BlockSize() * S->BlockSize();
+  if (work_x.size() < size_x) work_x.resize(size_x);
+  if (work_y.size() < size_y) work_y.resize(size_y);
+  if (work_diag.size() < size_diag) work_diag.resize(size_diag);
+
+  if (!valA.empty()) {
+    if (work_b.size() < size_x) work_b.resize(size_x);
+    if (work_r.size() < size_x) work_r.resize(size_x);
+    if (work_best.size() < size_x) work_best.resize(size_x);
+  }
+  if (!SnColumnsSingle.empty()) {
+    if (work_single_x.size() < size_x) work_single_x.resize(size_x);
+    if (work_single_y.size() < size_y) work_single_y.resize(size_y);
+  }
+  const size_t size_lowrank = (size_t)lowrank_k * nrhs;
+  if (work_lowrank.size() < size_lowrank) work_lowrank.resize(size_lowrank);
 }
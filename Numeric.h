@@ -1,20 +1,109 @@
 #ifndef NUMERIC_H
 #define NUMERIC_H
 
+#include <memory>
 #include <vector>
 
 #include "Auxiliary.h"
 #include "Blas_declaration.h"
 #include "DenseFact_declaration.h"
+#include "FactorFile.h"
+#include "Scheduler.h"
 #include "Symbolic.h"
 
 class Numeric {
+  // columns of L, in double or single precision
   std::vector<std::vector<double>> SnColumns{};
+  std::vector<std::vector<float>> SnColumnsSingle{};
   const Symbolic* S;
 
+  // After an out-of-core factorisation, the columns of L in double precision
+  // are in the file, and SnColumns is empty
+  std::shared_ptr<FactorFile> factor_file_ptr{};
+
+  // columns of supernode sn in double precision, in memory or in the file
+  const double* SnData(int sn) const {
+    return factor_file_ptr ? factor_file_ptr->Columns(sn)
+                           : SnColumns[sn].data();
+  }
+
+  // Matrix used by iterative refinement, permuted, lower triangle, and its
+  // infinity norm. It is empty if refinement is not needed.
+  std::vector<int> ptrA{};
+  std::vector<int> rowsA{};
+  std::vector<double> valA{};
+  double normA{};
+
+  // Low-rank correction U * U^T of the factorised matrix M (see SetLowRank),
+  // with U and W = M^-1 * U in the permuted ordering, and the Cholesky factor
+  // of the k x k matrix C = I + U^T * W. lowrank_k is zero if there is no
+  // correction.
+  int lowrank_k{};
+  std::vector<double> lowrank_U{};
+  std::vector<double> lowrank_W{};
+  std::vector<double> lowrank_C{};
+
+  // Workspace for the solves, sized from the largest front, so that a solve
+  // does not allocate memory. A Numeric object cannot be used to solve from
+  // more than one thread at the same time.
+  mutable std::vector<double> work_x{};
+  mutable std::vector<double> work_y{};
+  mutable std::vector<double> work_diag{};
+  mutable std::vector<double> work_b{};
+  mutable std::vector<double> work_r{};
+  mutable std::vector<double> work_best{};
+  mutable std::vector<float> work_single_x{};
+  mutable std::vector<float> work_single_y{};
+  mutable std::vector<double> work_lowrank{};
+
+  void PrepareWorkspace(int nrhs) const;
+
+  // pool of threads used for the parallel solves
+  std::shared_ptr<Scheduler> pool{};
+
+  // Data for the parallel solves: supernodes above layer0, thread that solved
+  // each subtree of layer0 and buffers of each thread
+  std::vector<int> sn_above_layer0{};
+  mutable std::vector<int> subtree_thread{};
+  mutable std::vector<double> work_par_y{};
+  mutable std::vector<double> work_par_up{};
+
+  void PrepareParallel();
+  bool SolveInParallel() const;
+
+  // forward and backward solves with a single supernode
+  void LsolveSn(int sn, double* x, double* y, double* x_up, int up_start) const;
+  void LtsolveSn(int sn, double* x, double* y) const;
+
+  void SetMatrix(const std::vector<int>& ptr, const std::vector<int>& rows,
+                 std::vector<double>&& val);
+
+  // solves with the factor, in the permuted ordering
+  void SolveFactor(std::vector<double>& x, int nrhs) const;
+  void SolveSingle(float* x, int nrhs) const;
+  void Refine(int nrhs) const;
+  void SolveMatrix(int nrhs) const;
+  void ApplyLowRank(int nrhs) const;
+
   friend class Factorise;
 
  public:
+  // Iterative refinement is used if the factor is in single precision, or if
+  // some pivots were perturbed. It stops when the scaled residual
+  // ||b - Ax|| / (||A|| ||x|| + ||b||) is below refine_tol, when a step does
+  // not reduce it by at least a factor refine_contraction, or after
+  // refine_max_iter steps. The solution with the smallest residual is
+  // returned.
+  int refine_max_iter = 10;
+  double refine_tol = 1e-14;
+  double refine_contraction = 1.0;
+
+  // steps of refinement and scaled residual of the last solve
+  mutable int refine_iter{};
+  mutable double refine_residual{};
+
+  // The partial solves are available only with a double precision factor.
+
   // Forward solve with single right hand side
   void Lsolve(std::vector<double>& x) const;
 
@@ -26,6 +115,25 @@ class Numeric {
 
   // Full solve
   void Solve(std::vector<double>& x) const;
+
+  // Solve with M + U * U^T instead of the factorised matrix M, where U has k
+  // columns, stored by columns with leading dimension equal to the size of M,
+  // in the original ordering. This is used for the normal equations, where
+  // the dense columns of A are left out of M.
+  // Solve then applies the Sherman-Morrison-Woodbury formula
+  //  (M + U U^T)^-1 = M^-1 - M^-1 U (I + U^T M^-1 U)^-1 U^T M^-1,
+  // which needs k solves with M here, and two products with n x k matrices for
+  // each solve. The partial solves are not affected. M must be positive
+  // definite, and the correction must be set again after each factorisation.
+  // k = 0 removes the correction.
+  int SetLowRank(const std::vector<double>& U, int k);
+
+  // Solves with nrhs right hand sides, stored by columns in x, with leading
+  // dimension equal to the size of the matrix
+  void Lsolve(std::vector<double>& x, int nrhs) const;
+  void Ltsolve(std::vector<double>& x, int nrhs) const;
+  void Dsolve(std::vector<double>& x, int nrhs) const;
+  void Solve(std::vector<double>& x, int nrhs) const;
 };
 
 #endif
\ No newline at end of file
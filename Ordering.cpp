@@ -0,0 +1,560 @@
+#include "Ordering.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "Auxiliary.h"
+#include "DenseFact_declaration.h"
+#include "metis.h"
+
+// subgraphs smaller than this are not split further by ParallelNestedDissection
+const int k_min_dissection_size = 1000;
+
+// Encode and decode the index of a node that was absorbed into element i, as in
+// CSparse. Flip(i) is negative for any i >= 0.
+static int Flip(int i) { return -i - 2; }
+
+static int ClearMark(int mark, int lemax, std::vector<int>& w, int n) {
+  // Make sure that w[i] < mark for all the nodes and elements, without
+  // overflowing. Dead elements have w[i] = 0 and are not touched.
+  if (mark < 2 || mark + lemax < 0) {
+    for (int k = 0; k < n; ++k) {
+      if (w[k] != 0) w[k] = 1;
+    }
+    mark = 2;
+  }
+  return mark;
+}
+
+static int TreeDfs(int j, int k, std::vector<int>& head,
+                   const std::vector<int>& next, std::vector<int>& post,
+                   std::vector<int>& stack) {
+  // Postorder the subtree rooted at j, starting from position k, with a
+  // non-recursive depth first search
+  int top = 0;
+  stack[0] = j;
+  while (top >= 0) {
+    const int p = stack[top];
+    const int i = head[p];
+    if (i == -1) {
+      --top;
+      post[k++] = p;
+    } else {
+      head[p] = next[i];
+      stack[++top] = i;
+    }
+  }
+  return k;
+}
+
+int AmdOrder(int n, const std::vector<int>& ptr, const std::vector<int>& rows,
+             std::vector<int>& perm, std::vector<int>& iperm) {
+  perm.resize(n);
+  iperm.resize(n);
+  if (n == 0) return ret_ok;
+
+  // nodes with degree larger than dense are ordered last
+  int dense = std::max(16.0, 10.0 * std::sqrt((double)n));
+  dense = std::min(n - 2, dense);
+
+  // Quotient graph: the adjacency lists of the nodes and elements are stored
+  // in Ci, with some elbow room to create new elements.
+  // Cp[i] is the start of the list of node or element i; for a node absorbed
+  // into element e, Cp[i] = Flip(e), which is later used as the assembly tree.
+  int cnz = ptr[n];
+  const int nzmax = cnz + cnz / 5 + 2 * n;
+  std::vector<int> Cp(ptr.begin(), ptr.begin() + n + 1);
+  std::vector<int> Ci(nzmax);
+  std::copy(rows.begin(), rows.begin() + cnz, Ci.begin());
+
+  // len[i]: length of the list of i
+  // nv[i]: number of nodes represented by supervariable i, negative if i is in
+  //        the current element, zero if i is dead
+  // next, last, head: degree lists; next and last are also used for the hash
+  //                   lists
+  // elen[i]: number of elements in the list of node i, -1 for a dead node and
+  //          -2 for an element
+  // degree[i]: approximate external degree of node i
+  // w[e]: |Le\Lk| during the computation of the set differences
+  // hhead: heads of the hash lists
+  std::vector<int> len(n + 1), nv(n + 1), next(n + 1), head(n + 1);
+  std::vector<int> elen(n + 1), degree(n + 1), w(n + 1), hhead(n + 1);
+  std::vector<int> last(n + 1);
+
+  // ===========================================================================
+  // Initialise the quotient graph
+  // ===========================================================================
+  for (int k = 0; k < n; ++k) len[k] = Cp[k + 1] - Cp[k];
+  len[n] = 0;
+  for (int i = 0; i <= n; ++i) {
+    head[i] = -1;
+    last[i] = -1;
+    next[i] = -1;
+    hhead[i] = -1;
+    nv[i] = 1;
+    w[i] = 1;
+    elen[i] = 0;
+    degree[i] = len[i];
+  }
+  int mark = ClearMark(0, 0, w, n);
+
+  // n is a dead element, into which the dense nodes are absorbed
+  elen[n] = -2;
+  Cp[n] = -1;
+  w[n] = 0;
+
+  // ===========================================================================
+  // Initialise the degree lists
+  // ===========================================================================
+  int nel{};
+  for (int i = 0; i < n; ++i) {
+    const int d = degree[i];
+    if (d == 0) {
+      // empty node: it becomes a root of the assembly tree
+      elen[i] = -2;
+      ++nel;
+      Cp[i] = -1;
+      w[i] = 0;
+    } else if (d > dense) {
+      // dense node: absorb it into element n
+      nv[i] = 0;
+      elen[i] = -1;
+      ++nel;
+      Cp[i] = Flip(n);
+      ++nv[n];
+    } else {
+      if (head[d] != -1) last[head[d]] = i;
+      next[i] = head[d];
+      head[d] = i;
+    }
+  }
+
+  int mindeg{};
+  int lemax{};
+  while (nel < n) {
+    // =========================================================================
+    // Select the node of minimum approximate degree
+    // =========================================================================
+    int k = -1;
+    for (; mindeg < n && (k = head[mindeg]) == -1; ++mindeg) {
+    }
+    if (next[k] != -1) last[next[k]] = -1;
+    head[mindeg] = next[k];
+    const int elenk = elen[k];
+    int nvk = nv[k];
+    nel += nvk;
+
+    // =========================================================================
+    // Garbage collection
+    // =========================================================================
+    if (elenk > 0 && cnz + mindeg >= nzmax) {
+      for (int j = 0; j < n; ++j) {
+        const int p = Cp[j];
+        if (p >= 0) {
+          // save the first entry of the object, and mark its start with j
+          Cp[j] = Ci[p];
+          Ci[p] = Flip(j);
+        }
+      }
+      int q{};
+      for (int p = 0; p < cnz;) {
+        const int j = Flip(Ci[p++]);
+        if (j >= 0) {
+          // found the start of object j: move it to position q
+          Ci[q] = Cp[j];
+          Cp[j] = q++;
+          for (int k3 = 0; k3 < len[j] - 1; ++k3) Ci[q++] = Ci[p++];
+        }
+      }
+      cnz = q;
+    }
+
+    // =========================================================================
+    // Construct the new element Lk
+    // =========================================================================
+    int dk{};
+    nv[k] = -nvk;
+    int p = Cp[k];
+
+    // the element is built in place if k is not adjacent to any element
+    const int pk1 = elenk == 0 ? p : cnz;
+    int pk2 = pk1;
+    for (int k1 = 1; k1 <= elenk + 1; ++k1) {
+      int e, pj, ln;
+      if (k1 > elenk) {
+        // search the nodes adjacent to k
+        e = k;
+        pj = p;
+        ln = len[k] - elenk;
+      } else {
+        // search the nodes of element e
+        e = Ci[p++];
+        pj = Cp[e];
+        ln = len[e];
+      }
+      for (int k2 = 1; k2 <= ln; ++k2) {
+        const int i = Ci[pj++];
+        const int nvi = nv[i];
+
+        // node dead, or already in Lk
+        if (nvi <= 0) continue;
+
+        // add i to Lk and remove it from its degree list
+        dk += nvi;
+        nv[i] = -nvi;
+        Ci[pk2++] = i;
+        if (next[i] != -1) last[next[i]] = last[i];
+        if (last[i] != -1)
+          next[last[i]] = next[i];
+        else
+          head[degree[i]] = next[i];
+      }
+      if (e != k) {
+        // absorb e into k
+        Cp[e] = Flip(k);
+        w[e] = 0;
+      }
+    }
+    if (elenk != 0) cnz = pk2;
+    degree[k] = dk;
+    Cp[k] = pk1;
+    len[k] = pk2 - pk1;
+    elen[k] = -2;
+
+    // =========================================================================
+    // Find the set differences |Le\Lk| for all the elements e
+    // =========================================================================
+    mark = ClearMark(mark, lemax, w, n);
+    for (int pk = pk1; pk < pk2; ++pk) {
+      const int i = Ci[pk];
+      const int eln = elen[i];
+      if (eln <= 0) continue;
+      const int nvi = -nv[i];
+      const int wnvi = mark - nvi;
+      for (p = Cp[i]; p <= Cp[i] + eln - 1; ++p) {
+        const int e = Ci[p];
+        if (w[e] >= mark) {
+          w[e] -= nvi;
+        } else if (w[e] != 0) {
+          // first time that the live element e is seen
+          w[e] = degree[e] + wnvi;
+        }
+      }
+    }
+
+    // =========================================================================
+    // Update the degrees of the nodes in Lk
+    // =========================================================================
+    for (int pk = pk1; pk < pk2; ++pk) {
+      const int i = Ci[pk];
+      const int p1 = Cp[i];
+      const int p2 = p1 + elen[i] - 1;
+      int pn = p1;
+      int64_t h{};
+      int d{};
+
+      // scan the elements adjacent to i
+      for (p = p1; p <= p2; ++p) {
+        const int e = Ci[p];
+        if (w[e] != 0) {
+          const int dext = w[e] - mark;
+          if (dext > 0) {
+            d += dext;
+            Ci[pn++] = e;
+            h += e;
+          } else {
+            // aggressive absorption of e into k
+            Cp[e] = Flip(k);
+            w[e] = 0;
+          }
+        }
+      }
+      elen[i] = pn - p1 + 1;
+
+      // prune the nodes adjacent to i
+      const int p3 = pn;
+      const int p4 = p1 + len[i];
+      for (p = p2 + 1; p < p4; ++p) {
+        const int j = Ci[p];
+        const int nvj = nv[j];
+        if (nvj <= 0) continue;
+        d += nvj;
+        Ci[pn++] = j;
+        h += j;
+      }
+
+      if (d == 0) {
+        // mass elimination: i is only adjacent to k, absorb i into k
+        Cp[i] = Flip(k);
+        const int nvi = -nv[i];
+        dk -= nvi;
+        nvk += nvi;
+        nel += nvi;
+        nv[i] = 0;
+        elen[i] = -1;
+      } else {
+        degree[i] = std::min(degree[i], d);
+
+        // add k as the first element adjacent to i
+        Ci[pn] = Ci[p3];
+        Ci[p3] = Ci[p1];
+        Ci[p1] = k;
+        len[i] = pn - p1 + 1;
+
+        // place i in its hash bucket, and save the hash in last[i]
+        const int hash = (h < 0 ? -h : h) % n;
+        next[i] = hhead[hash];
+        hhead[hash] = i;
+        last[i] = hash;
+      }
+    }
+    degree[k] = dk;
+    lemax = std::max(lemax, dk);
+    mark = ClearMark(mark + lemax, lemax, w, n);
+
+    // =========================================================================
+    // Detect indistinguishable nodes (supervariables)
+    // =========================================================================
+    for (int pk = pk1; pk < pk2; ++pk) {
+      int i = Ci[pk];
+      if (nv[i] >= 0) continue;
+
+      // scan the hash bucket of node i, which is then emptied
+      const int hash = last[i];
+      i = hhead[hash];
+      hhead[hash] = -1;
+      for (; i != -1 && next[i] != -1; i = next[i], ++mark) {
+        const int ln = len[i];
+        const int eln = elen[i];
+        for (p = Cp[i] + 1; p <= Cp[i] + ln - 1; ++p) w[Ci[p]] = mark;
+        int jlast = i;
+
+        // compare i with all the following nodes j in the bucket
+        for (int j = next[i]; j != -1;) {
+          bool ok = len[j] == ln && elen[j] == eln;
+          for (p = Cp[j] + 1; ok && p <= Cp[j] + ln - 1; ++p) {
+            if (w[Ci[p]] != mark) ok = false;
+          }
+          if (ok) {
+            // i and j are identical: absorb j into i
+            Cp[j] = Flip(i);
+            nv[i] += nv[j];
+            nv[j] = 0;
+            elen[j] = -1;
+            j = next[j];
+            next[jlast] = j;
+          } else {
+            jlast = j;
+            j = next[j];
+          }
+        }
+      }
+    }
+
+    // =========================================================================
+    // Finalise the new element
+    // =========================================================================
+    p = pk1;
+    for (int pk = pk1; pk < pk2; ++pk) {
+      const int i = Ci[pk];
+      const int nvi = -nv[i];
+      if (nvi <= 0) continue;
+      nv[i] = nvi;
+
+      // external degree of i, and put i back in the degree lists
+      int d = degree[i] + dk - nvi;
+      d = std::min(d, n - nel - nvi);
+      if (head[d] != -1) last[head[d]] = i;
+      next[i] = head[d];
+      last[i] = -1;
+      head[d] = i;
+      mindeg = std::min(mindeg, d);
+      degree[i] = d;
+      Ci[p++] = i;
+    }
+    nv[k] = nvk;
+    len[k] = p - pk1;
+    if (len[k] == 0) {
+      // k is a root of the assembly tree
+      Cp[k] = -1;
+      w[k] = 0;
+    }
+    if (elenk != 0) cnz = p;
+  }
+
+  // ===========================================================================
+  // Postorder the assembly tree
+  // ===========================================================================
+  // Cp now contains the parent of each node and element in the assembly tree
+  for (int i = 0; i < n; ++i) Cp[i] = Flip(Cp[i]);
+  for (int j = 0; j <= n; ++j) head[j] = -1;
+
+  // place the absorbed nodes in the list of their parent, and then the
+  // elements, so that the nodes come before the elements they belong to
+  for (int j = n; j >= 0; --j) {
+    if (nv[j] > 0) continue;
+    next[j] = head[Cp[j]];
+    head[Cp[j]] = j;
+  }
+  for (int e = n; e >= 0; --e) {
+    if (nv[e] <= 0) continue;
+    if (Cp[e] != -1) {
+      next[e] = head[Cp[e]];
+      head[Cp[e]] = e;
+    }
+  }
+
+  // element n is a root and is ordered last
+  std::vector<int> post(n + 1);
+  for (int k = 0, i = 0; i <= n; ++i) {
+    if (Cp[i] == -1) k = TreeDfs(i, k, head, next, post, w);
+  }
+
+  std::copy(post.begin(), post.begin() + n, perm.begin());
+  InversePerm(perm, iperm);
+  return ret_ok;
+}
+
+static int MetisStatus(int status, const char* function) {
+  // Convert the status returned by a Metis function into a ret_value
+  switch (status) {
+    case METIS_OK:
+      return ret_ok;
+    case METIS_ERROR_INPUT:
+      printf("%s: invalid input graph\n", function);
+      return ret_invalid_input;
+    case METIS_ERROR_MEMORY:
+      printf("%s: out of memory\n", function);
+      return ret_out_of_memory;
+    default:
+      printf("%s: error %d\n", function, status);
+      return ret_generic;
+  }
+}
+
+int MetisOrder(int n, std::vector<int>& ptr, std::vector<int>& rows,
+               std::vector<int>& perm, std::vector<int>& iperm) {
+  perm.resize(n);
+  iperm.resize(n);
+  if (n == 0) return ret_ok;
+
+  int options[METIS_NOPTIONS];
+  METIS_SetDefaultOptions(options);
+  int status = METIS_NodeND(&n, ptr.data(), rows.data(), NULL, options,
+                            perm.data(), iperm.data());
+  return MetisStatus(status, "METIS_NodeND");
+}
+
+static void Subgraph(const std::vector<int>& ptr, const std::vector<int>& rows,
+                     const std::vector<int>& part, int p,
+                     const std::vector<int>& local, std::vector<int>& sub_ptr,
+                     std::vector<int>& sub_rows) {
+  // Extract the subgraph induced by the nodes i with part[i] == p.
+  // local[i] is the index of node i in the subgraph.
+
+  sub_ptr.assign(1, 0);
+  sub_rows.clear();
+  const int n = ptr.size() - 1;
+  for (int j = 0; j < n; ++j) {
+    if (part[j] != p) continue;
+    for (int el = ptr[j]; el < ptr[j + 1]; ++el) {
+      const int i = rows[el];
+      if (part[i] == p) sub_rows.push_back(local[i]);
+    }
+    sub_ptr.push_back(sub_rows.size());
+  }
+}
+
+static int Dissect(std::vector<int>& ptr, std::vector<int>& rows,
+                   const std::vector<int>& nodes, int levels,
+                   const OrderFunction& order_part, Scheduler& pool,
+                   int* order) {
+  // Order the subgraph given by ptr and rows, whose node i is node nodes[i] of
+  // the whole graph. The nodes of the whole graph are written in order, in
+  // elimination order. Return the first error of the subgraph, if any.
+
+  int n = nodes.size();
+
+  std::vector<int> part;
+  int sep_size{};
+  if (levels > 0 && n >= k_min_dissection_size) {
+    part.resize(n);
+    int options[METIS_NOPTIONS];
+    METIS_SetDefaultOptions(options);
+    int status = METIS_ComputeVertexSeparator(&n, ptr.data(), rows.data(), NULL,
+                                              options, &sep_size, part.data());
+    status = MetisStatus(status, "METIS_ComputeVertexSeparator");
+    if (status) return status;
+  }
+
+  // number of nodes in each part, and their index within the part
+  int part_size[3]{};
+  std::vector<int> local(part.size());
+  for (int i = 0; i < part.size(); ++i) local[i] = part_size[part[i]]++;
+
+  // order the subgraph as a whole at the last level, or if the separator did
+  // not split it
+  if (part.empty() || part_size[0] == 0 || part_size[1] == 0) {
+    std::vector<int> perm, iperm;
+    const int status = order_part(n, ptr, rows, perm, iperm);
+    if (status) return status;
+    for (int i = 0; i < n; ++i) order[i] = nodes[perm[i]];
+    return ret_ok;
+  }
+
+  // the parts are ordered first, and the separator last
+  std::vector<int> ptr0, rows0, ptr1, rows1;
+  Subgraph(ptr, rows, part, 0, local, ptr0, rows0);
+  Subgraph(ptr, rows, part, 1, local, ptr1, rows1);
+  std::vector<int> nodes0(part_size[0]), nodes1(part_size[1]);
+  int* sep_order = order + part_size[0] + part_size[1];
+  for (int i = 0; i < n; ++i) {
+    if (part[i] == 0)
+      nodes0[local[i]] = nodes[i];
+    else if (part[i] == 1)
+      nodes1[local[i]] = nodes[i];
+    else
+      sep_order[local[i]] = nodes[i];
+  }
+
+  // free the subgraph, before going down the recursion
+  std::vector<int>().swap(ptr);
+  std::vector<int>().swap(rows);
+  std::vector<int>().swap(part);
+  std::vector<int>().swap(local);
+
+  // the first part is processed by another thread, if one is available
+  std::atomic<int> left{1};
+  int status0 = ret_ok;
+  pool.Spawn([&] {
+    status0 = Dissect(ptr0, rows0, nodes0, levels - 1, order_part, pool, order);
+    --left;
+  });
+  const int status1 = Dissect(ptr1, rows1, nodes1, levels - 1, order_part,
+                              pool, order + nodes0.size());
+  pool.Wait(left);
+  return status0 ? status0 : status1;
+}
+
+int ParallelNestedDissection(int n, const std::vector<int>& ptr,
+                             const std::vector<int>& rows, int levels,
+                             const OrderFunction& order_part, Scheduler& pool,
+                             std::vector<int>& perm, std::vector<int>& iperm) {
+  perm.resize(n);
+  iperm.resize(n);
+  if (n == 0) return ret_ok;
+
+  std::vector<int> sub_ptr(ptr);
+  std::vector<int> sub_rows(rows);
+  std::vector<int> nodes(n);
+  for (int i = 0; i < n; ++i) nodes[i] = i;
+
+  const int status =
+      Dissect(sub_ptr, sub_rows, nodes, levels, order_part, pool, perm.data());
+  if (status) return status;
+  InversePerm(perm, iperm);
+  return ret_ok;
+}
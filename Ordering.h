@@ -0,0 +1,51 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include <functional>
+#include <vector>
+
+#include "Scheduler.h"
+
+// Fill-reducing orderings.
+//
+// The input is the adjacency structure of the graph of the matrix in CSC
+// format, with both triangles stored and without the diagonal, i.e. the same
+// input that is given to Metis.
+// On output, perm[i] is the original index of the node in position i, and
+// iperm is the inverse of perm.
+// The functions return ret_ok, or the ret_value of the first error.
+
+// Approximate minimum degree ordering.
+// Taken from Tim Davis "Direct Methods for Sparse Linear Systems" (cs_amd),
+// which uses the quotient graph, approximate external degrees, element
+// absorption, mass elimination and detection of indistinguishable nodes.
+// Nodes with degree larger than max(16, 10*sqrt(n)) are considered dense and
+// are ordered last.
+int AmdOrder(int n, const std::vector<int>& ptr, const std::vector<int>& rows,
+             std::vector<int>& perm, std::vector<int>& iperm);
+
+// Ordering of a graph, with the same input and output as above. The arrays of
+// the graph may be modified.
+typedef std::function<int(int n, std::vector<int>& ptr,
+                           std::vector<int>& rows, std::vector<int>& perm,
+                           std::vector<int>& iperm)>
+    OrderFunction;
+
+// Metis nested dissection, as an OrderFunction
+int MetisOrder(int n, std::vector<int>& ptr, std::vector<int>& rows,
+               std::vector<int>& perm, std::vector<int>& iperm);
+
+// Nested dissection computed in parallel.
+// The graph is split recursively with vertex separators computed by Metis, for
+// at most levels levels. The two parts of each split are processed as
+// independent tasks of pool, and the parts of the last level are ordered with
+// order_part. In each subgraph, the nodes of the two parts come first and the
+// nodes of the separator last.
+// Metis is called concurrently from several threads, so it must be built with
+// thread-local storage in GKlib (the default from Metis 5.2).
+int ParallelNestedDissection(int n, const std::vector<int>& ptr,
+                             const std::vector<int>& rows, int levels,
+                             const OrderFunction& order_part, Scheduler& pool,
+                             std::vector<int>& perm, std::vector<int>& iperm);
+
+#endif
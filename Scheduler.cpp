@@ -0,0 +1,134 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+// Scheduler and index of the calling thread, if it is a worker
+static thread_local const Scheduler* tls_scheduler = nullptr;
+static thread_local int tls_thread = 0;
+
+Scheduler::Scheduler(int n_threads_input) {
+  n_threads = std::max(1, n_threads_input);
+  deques.reset(new TaskDeque[n_threads]);
+
+  // thread 0 is the thread that waits for the tasks
+  for (int thread = 1; thread < n_threads; ++thread) {
+    workers.emplace_back(&Scheduler::WorkerLoop, this, thread);
+  }
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stop = true;
+  }
+  sleep_cv.notify_all();
+  for (std::thread& t : workers) t.join();
+}
+
+int Scheduler::Threads() const { return n_threads; }
+
+int Scheduler::ThreadId() const {
+  return tls_scheduler == this ? tls_thread : 0;
+}
+
+bool Scheduler::Pop(int thread, Task& task) {
+  // take the most recent task of the deque of thread
+  TaskDeque& d = deques[thread];
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if (d.tasks.empty()) return false;
+  task = std::move(d.tasks.back());
+  d.tasks.pop_back();
+  --pending;
+  return true;
+}
+
+bool Scheduler::Steal(int thread, Task& task) {
+  // take the oldest task from the deque of another thread
+  for (int i = 1; i < n_threads; ++i) {
+    TaskDeque& d = deques[(thread + i) % n_threads];
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.tasks.empty()) continue;
+    task = std::move(d.tasks.front());
+    d.tasks.pop_front();
+    --pending;
+    return true;
+  }
+  return false;
+}
+
+void Scheduler::WorkerLoop(int thread) {
+  tls_scheduler = this;
+  tls_thread = thread;
+
+  Task task;
+  while (true) {
+    if (Pop(thread, task) || Steal(thread, task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    // no task available, sleep until a new task is spawned
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleep_cv.wait(lock, [this] { return stop || pending > 0; });
+    if (stop) break;
+  }
+}
+
+void Scheduler::Spawn(Task task) {
+  TaskDeque& d = deques[ThreadId()];
+  {
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.tasks.push_back(std::move(task));
+    ++pending;
+  }
+
+  // wake up a sleeping worker, if any
+  if (n_threads > 1) {
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    sleep_cv.notify_one();
+  }
+}
+
+void Scheduler::Wait(const std::atomic<int>& counter) {
+  // the calling thread executes tasks, rather than waiting idle
+  const int thread = ThreadId();
+  Task task;
+  while (counter > 0) {
+    if (Pop(thread, task) || Steal(thread, task)) {
+      task();
+      task = nullptr;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void Scheduler::ParallelFor(int n, const std::function<void(int)>& f) {
+  // The indices are claimed one at a time, by the calling thread and by up to
+  // Threads()-1 helper tasks. While the indices claimed by other threads are
+  // completed, the calling thread waits without executing other tasks, so that
+  // an unrelated task cannot delay it, or run inside the timers of the caller.
+  // The counters are shared with the helpers, which may start after the loop
+  // is over; f is called only for indices claimed before that.
+  if (n <= 0) return;
+
+  struct Counters {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+  };
+  std::shared_ptr<Counters> counters = std::make_shared<Counters>();
+  const std::function<void(int)>* f_ptr = &f;
+  auto claim = [counters, f_ptr, n] {
+    int i;
+    while ((i = counters->next++) < n) {
+      (*f_ptr)(i);
+      ++counters->done;
+    }
+  };
+
+  const int helpers = std::min(n, n_threads) - 1;
+  for (int h = 0; h < helpers; ++h) Spawn(claim);
+  claim();
+  while (counters->done < n) std::this_thread::yield();
+}
@@ -0,0 +1,72 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of threads that execute tasks, using work stealing.
+// Each thread owns a deque of tasks. New tasks are added to the back of the
+// deque of the thread that creates them, and a thread executes tasks taken from
+// the back of its own deque. When its deque is empty, a thread steals tasks
+// from the front of the deques of the other threads.
+// A pool with n_threads threads creates n_threads-1 worker threads. Any thread
+// that does not belong to the pool (e.g., the main thread) acts as thread 0
+// while it waits for tasks to finish.
+class Scheduler {
+ public:
+  typedef std::function<void()> Task;
+
+ private:
+  struct TaskDeque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  int n_threads{};
+  std::unique_ptr<TaskDeque[]> deques{};
+  std::vector<std::thread> workers{};
+
+  // number of tasks waiting in the deques
+  std::atomic<int> pending{0};
+
+  // used to put idle workers to sleep
+  std::mutex sleep_mutex{};
+  std::condition_variable sleep_cv{};
+  bool stop = false;
+
+  bool Pop(int thread, Task& task);
+  bool Steal(int thread, Task& task);
+  void WorkerLoop(int thread);
+
+ public:
+  explicit Scheduler(int n_threads_input);
+  ~Scheduler();
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  // number of threads, including thread 0
+  int Threads() const;
+
+  // index of the calling thread, in [0, Threads())
+  int ThreadId() const;
+
+  // Add a task to the deque of the calling thread
+  void Spawn(Task task);
+
+  // Execute tasks until counter reaches zero
+  void Wait(const std::atomic<int>& counter);
+
+  // Execute f(i) for i = 0,...,n-1 in parallel and return when all are done.
+  // Can be called from within a task. The calling thread executes only calls
+  // of f while it waits.
+  void ParallelFor(int n, const std::function<void(int)>& f);
+};
+
+#endif
@@ -1,7 +1,16 @@
 #include "Symbolic.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
+#include "DenseFact_declaration.h"
+
 void Symbolic::Print() const {
   printf("Symbolic factorisation:\n");
   printf(" - type                 %s\n",
@@ -19,6 +28,8 @@ void Symbolic::Print() const {
          (double)artificialNz / nz * 100);
   printf(" - artificial ops       %.2e (%4.1f%%)\n", artificialOp,
          artificialOp / operations * 100);
+  printf(" - threads              %d\n", threads);
+  printf(" - layer0 subtrees      %d\n", (int)layer0.size());
 
   if (maxStorage > 0) {
     printf(" - est. max memory      ");
@@ -41,14 +52,20 @@ int Symbolic::Size() const { return n; }
 int Symbolic::Nz() const { return nz; }
 double Symbolic::Ops() const { return operations; }
 double Symbolic::AssemblyOps() const { return assemblyOp; }
+double Symbolic::MaxStorage() const { return maxStorage; }
 int Symbolic::Sn() const { return sn; }
 int Symbolic::Rows(int i) const { return rows[i]; }
 int Symbolic::Ptr(int i) const { return ptr[i]; }
 int Symbolic::SnStart(int i) const { return snStart[i]; }
 int Symbolic::RelindCols(int i) const { return relindCols[i]; }
-int Symbolic::RelindClique(int i, int j) const { return relindClique[i][j]; }
-int Symbolic::ConsecutiveSums(int i, int j) const {
-  return consecutiveSums[i][j];
+int Symbolic::RelindClique(int i, int j) const {
+  return relindClique[relindCliquePtr[i] + j];
+}
+const CliqueRun* Symbolic::CliqueRuns(int i) const {
+  return cliqueRuns.data() + cliqueRunsPtr[i];
+}
+int Symbolic::CliqueRunsCount(int i) const {
+  return cliqueRunsPtr[i + 1] - cliqueRunsPtr[i];
 }
 
 const std::vector<int>& Symbolic::Ptr() const { return ptr; }
@@ -56,3 +73,216 @@ const std::vector<int>& Symbolic::Perm() const { return perm; }
 const std::vector<int>& Symbolic::Iperm() const { return iperm; }
 const std::vector<int>& Symbolic::SnParent() const { return snParent; }
 const std::vector<int>& Symbolic::SnStart() const { return snStart; }
+const std::vector<int>& Symbolic::Layer0() const { return layer0; }
+const std::vector<int>& Symbolic::Layer0Start() const { return layer0Start; }
+int Symbolic::Threads() const { return threads; }
+int Symbolic::LargestFront() const { return largestFront; }
+int Symbolic::LargestSn() const { return largestSn; }
+
+uint64_t PatternHash(const std::vector<int>& rows, const std::vector<int>& ptr,
+                     FactType type) {
+  // FNV-1a hash of the size, type, column pointers and row indices
+
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const void* data, size_t bytes) {
+    const unsigned char* c = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+      hash ^= c[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+
+  const int n = ptr.size() - 1;
+  const int type_int = (int)type;
+  add(&n, sizeof(int));
+  add(&type_int, sizeof(int));
+  add(ptr.data(), sizeof(int) * ptr.size());
+  add(rows.data(), sizeof(int) * ptr.back());
+  return hash;
+}
+
+// Write count entries of size bytes each, preceded by count and padded to a
+// multiple of 8 bytes
+static bool WriteArray(FILE* file, const void* data, int64_t count,
+                       size_t size) {
+  const char zeros[8]{};
+  const size_t bytes = size * count;
+  const size_t padding = (8 - bytes % 8) % 8;
+  return fwrite(&count, sizeof(count), 1, file) == 1 &&
+         fwrite(data, 1, bytes, file) == bytes &&
+         fwrite(zeros, 1, padding, file) == padding;
+}
+
+// Read an array written by WriteArray, advancing pos
+template <typename T>
+static bool ReadArray(const char*& pos, const char* end, std::vector<T>& v) {
+  int64_t count;
+  if (end - pos < (ptrdiff_t)sizeof(count)) return false;
+  std::memcpy(&count, pos, sizeof(count));
+  pos += sizeof(count);
+
+  // check count before computing the size, which could overflow
+  const size_t remaining = end - pos;
+  if (count < 0 || (uint64_t)count > remaining / sizeof(T)) return false;
+  const size_t bytes = sizeof(T) * count;
+  const size_t padded = (bytes + 7) / 8 * 8;
+  if (padded > remaining) return false;
+  v.resize(count);
+  std::memcpy(v.data(), pos, bytes);
+  pos += padded;
+  return true;
+}
+
+int Symbolic::Save(const std::string& file_name, uint64_t hash) const {
+  SymbolicHeader header{};
+  std::memcpy(header.magic, "FACTSYM", 8);
+  header.version = k_symbolic_version;
+  header.type = (int)type;
+  header.packed = (int)packed;
+  header.block_size = blockSize;
+  header.n = n;
+  header.sn = sn;
+  header.artificial_nz = artificialNz;
+  header.largest_front = largestFront;
+  header.largest_sn = largestSn;
+  header.threads = threads;
+  header.ordering = ordering;
+  header.hash = hash;
+  header.nz = nz;
+  header.fillin = fillin;
+  header.max_storage = maxStorage;
+  header.operations = operations;
+  header.assembly_op = assemblyOp;
+  header.artificial_op = artificialOp;
+
+  FILE* file = fopen(file_name.c_str(), "wb");
+  if (!file) {
+    printf("Symbolic::Save: cannot open %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const std::vector<int>* v :
+       {&perm, &iperm, &rows, &ptr, &snParent, &snStart, &relindCols,
+        &relindCliquePtr, &relindClique, &cliqueRunsPtr}) {
+    ok = ok && WriteArray(file, v->data(), v->size(), sizeof(int));
+  }
+  ok = ok && WriteArray(file, cliqueRuns.data(), cliqueRuns.size(),
+                        sizeof(CliqueRun));
+  ok = ok && WriteArray(file, layer0.data(), layer0.size(), sizeof(int));
+  ok = ok &&
+       WriteArray(file, layer0Start.data(), layer0Start.size(), sizeof(int));
+  fclose(file);
+
+  if (!ok) {
+    printf("Symbolic::Save: error writing %s\n", file_name.c_str());
+    return ret_generic;
+  }
+  return ret_ok;
+}
+
+int Symbolic::Load(const std::string& file_name, uint64_t hash,
+                   OrderType ordering_input, PackType packed_input) {
+  // The file is memory-mapped and the arrays are copied from it into a
+  // temporary object, which replaces this one only if the file is valid
+
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return ret_invalid_input;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SymbolicHeader)) {
+    close(fd);
+    printf("Symbolic::Load: invalid file %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+  const size_t size = st.st_size;
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Symbolic::Load: mmap failed for %s\n", file_name.c_str());
+    return ret_generic;
+  }
+
+  const char* pos = static_cast<const char*>(data);
+  const char* end = pos + size;
+
+  SymbolicHeader header;
+  std::memcpy(&header, pos, sizeof(header));
+  pos += sizeof(header);
+
+  int status = ret_ok;
+  if (std::memcmp(header.magic, "FACTSYM", 8) != 0 ||
+      header.version != k_symbolic_version ||
+      header.block_size != blockSize) {
+    printf("Symbolic::Load: invalid or old file %s\n", file_name.c_str());
+    status = ret_invalid_input;
+  } else if (header.hash != hash) {
+    printf("Symbolic::Load: %s was saved for a different matrix\n",
+           file_name.c_str());
+    status = ret_invalid_input;
+  } else if (header.ordering != (int)ordering_input ||
+             header.packed != (int)packed_input) {
+    printf("Symbolic::Load: %s was saved with a different ordering or format\n",
+           file_name.c_str());
+    status = ret_invalid_input;
+  }
+
+  Symbolic loaded;
+  bool ok = status == ret_ok;
+  for (std::vector<int>* v :
+       {&loaded.perm, &loaded.iperm, &loaded.rows, &loaded.ptr,
+        &loaded.snParent, &loaded.snStart, &loaded.relindCols,
+        &loaded.relindCliquePtr, &loaded.relindClique, &loaded.cliqueRunsPtr}) {
+    ok = ok && ReadArray(pos, end, *v);
+  }
+  ok = ok && ReadArray(pos, end, loaded.cliqueRuns);
+  ok = ok && ReadArray(pos, end, loaded.layer0);
+  ok = ok && ReadArray(pos, end, loaded.layer0Start);
+
+  munmap(data, size);
+
+  if (status) return status;
+  if (!ok || loaded.ptr.size() != header.sn + 1 ||
+      loaded.perm.size() != header.n || loaded.iperm.size() != header.n ||
+      loaded.snStart.size() != header.sn + 1 ||
+      loaded.relindCliquePtr.size() != header.sn + 1 ||
+      loaded.relindCliquePtr.back() != loaded.relindClique.size() ||
+      loaded.cliqueRunsPtr.size() != header.sn + 1 ||
+      loaded.cliqueRunsPtr.back() != loaded.cliqueRuns.size()) {
+    printf("Symbolic::Load: invalid file %s\n", file_name.c_str());
+    return ret_invalid_input;
+  }
+
+  perm.swap(loaded.perm);
+  iperm.swap(loaded.iperm);
+  rows.swap(loaded.rows);
+  ptr.swap(loaded.ptr);
+  snParent.swap(loaded.snParent);
+  snStart.swap(loaded.snStart);
+  relindCols.swap(loaded.relindCols);
+  relindCliquePtr.swap(loaded.relindCliquePtr);
+  relindClique.swap(loaded.relindClique);
+  cliqueRunsPtr.swap(loaded.cliqueRunsPtr);
+  cliqueRuns.swap(loaded.cliqueRuns);
+  layer0.swap(loaded.layer0);
+  layer0Start.swap(loaded.layer0Start);
+
+  type = (FactType)header.type;
+  packed = (PackType)header.packed;
+  ordering = header.ordering;
+  n = header.n;
+  sn = header.sn;
+  artificialNz = header.artificial_nz;
+  largestFront = header.largest_front;
+  largestSn = header.largest_sn;
+  threads = header.threads;
+  nz = header.nz;
+  fillin = header.fillin;
+  maxStorage = header.max_storage;
+  operations = header.operations;
+  assemblyOp = header.assembly_op;
+  artificialOp = header.artificial_op;
+
+  return ret_ok;
+}
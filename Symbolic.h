@@ -1,6 +1,8 @@
 #ifndef SYMBOLIC_H
 #define SYMBOLIC_H
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 // Type of factorization:
@@ -8,6 +10,21 @@
 enum class FactType { NormEq, AugSys };
 enum class PackType { Full, Hybrid, Hybrid2 };
 
+// Fill-reducing ordering:
+// - Metis: nested dissection
+// - Amd: approximate minimum degree
+// - Auto: compute both and keep the one with fewer predicted operations
+enum class OrderType { Metis, Amd, Auto };
+
+// Run of consecutive relative indices in the clique of a supernode.
+// Rows source,...,source+length-1 of the clique correspond to rows
+// dest,...,dest+length-1 of the frontal matrix of the parent.
+struct CliqueRun {
+  int source;
+  int dest;
+  int length;
+};
+
 class Symbolic {
   // Type of factorization
   FactType type{};
@@ -15,6 +32,10 @@ class Symbolic {
   // Packed or full format
   PackType packed = PackType::Hybrid;
 
+  // Ordering requested to analyse (an OrderType), or -1 if the ordering was
+  // given by the user
+  int ordering = -1;
+
   // Size of blocks for dense factorization
   const int blockSize = 128;
 
@@ -72,25 +93,40 @@ class Symbolic {
   std::vector<int> relindCols{};
 
   // Relative indices of clique wrt parent supernode.
-  // - relindClique[i] contains the local indices of the nonzero rows of the
-  //   clique of the current supernode with respect to the numbering of the
-  //   parent supernode.
-  // - relindClique[i][j] = k implies that the row in position j in the clique
-  //   of supernode i corresponds to the row in position k in the frontal matrix
-  //   of supernode snParent[i].
+  // - relindClique contains the local indices of the nonzero rows of the
+  //   clique of each supernode with respect to the numbering of the parent
+  //   supernode. The indices of supernode i are stored in positions
+  //   relindCliquePtr[i] to relindCliquePtr[i+1]-1.
+  // - relindClique[relindCliquePtr[i] + j] = k implies that the row in
+  //   position j in the clique of supernode i corresponds to the row in
+  //   position k in the frontal matrix of supernode snParent[i].
   //   This is useful when summing the generated elements from supernode i into
   //   supernode snParent[i].
-  std::vector<std::vector<int>> relindClique{};
-
-  // Number of consecutive sums that can be done with one BLAS call.
-  // - consecutiveSums[i] contains information about the assembly of supernode i
-  //   into the frontal matrix of its parent.
-  // - consecutiveSums[i][j] = k implies that, when summing contributions from
-  //   row j of the clique of supernodes i into the frontal matrix of its
-  //   parent, k consecutive indices are found. This means that instead of doing
-  //   k individual sums, we can use one single call to daxpy, with k entries
-  //   and increment equal to one.
-  std::vector<std::vector<int>> consecutiveSums{};
+  std::vector<int> relindClique{};
+  std::vector<int> relindCliquePtr{};
+
+  // Runs of consecutive indices in relindClique.
+  // - cliqueRuns contains the maximal runs of consecutive relative indices of
+  //   the clique of each supernode, in increasing order of source. The runs of
+  //   supernode i are stored in positions cliqueRunsPtr[i] to
+  //   cliqueRunsPtr[i+1]-1.
+  // - Each run can be summed into the frontal matrix of the parent with a
+  //   single loop over contiguous entries, rather than entry by entry.
+  std::vector<CliqueRun> cliqueRuns{};
+  std::vector<int> cliqueRunsPtr{};
+
+  // Independent subtrees of the supernodal elimination tree, that can be
+  // processed in parallel.
+  // - layer0[i] is the root of the i-th subtree.
+  // - layer0Start[i] is the first supernode of the i-th subtree. Supernodes
+  //   are postordered, so the i-th subtree is made of the supernodes from
+  //   layer0Start[i] to layer0[i].
+  // Subtrees are sorted in decreasing order of estimated cost.
+  std::vector<int> layer0{};
+  std::vector<int> layer0Start{};
+
+  // Number of threads for which layer0 was generated
+  int threads{};
 
   friend class Analyse;
 
@@ -98,6 +134,16 @@ class Symbolic {
   // print information to screen
   void Print() const;
 
+  // Save to and load from a binary file.
+  // hash identifies the pattern of the matrix analysed (see PatternHash); Load
+  // fails if the file was saved with a different hash, ordering or packed
+  // format, with an ordering given by the user, or with a different version of
+  // the format. If Load fails, the object is not modified. Files are not
+  // portable across architectures.
+  int Save(const std::string& file_name, uint64_t hash) const;
+  int Load(const std::string& file_name, uint64_t hash, OrderType ordering,
+           PackType packed);
+
   // provide const access to symbolic factorization
   FactType Type() const;
   PackType Packed() const;
@@ -106,20 +152,62 @@ class Symbolic {
   int Nz() const;
   double Ops() const;
   double AssemblyOps() const;
+  double MaxStorage() const;
   int Sn() const;
   int Rows(int i) const;
   int Ptr(int i) const;
   int SnStart(int i) const;
   int RelindCols(int i) const;
   int RelindClique(int i, int j) const;
-  int ConsecutiveSums(int i, int j) const;
+  const CliqueRun* CliqueRuns(int i) const;
+  int CliqueRunsCount(int i) const;
   const std::vector<int>& Ptr() const;
   const std::vector<int>& Perm() const;
   const std::vector<int>& Iperm() const;
   const std::vector<int>& SnParent() const;
   const std::vector<int>& SnStart() const;
+  const std::vector<int>& Layer0() const;
+  const std::vector<int>& Layer0Start() const;
+  int Threads() const;
+  int LargestFront() const;
+  int LargestSn() const;
+};
+
+// Hash of the pattern of the lower triangle of a matrix and of the type of
+// factorisation, used to check that a saved Symbolic object can be reused.
+uint64_t PatternHash(const std::vector<int>& rows, const std::vector<int>& ptr,
+                     FactType type);
+
+// Binary format of a saved Symbolic object:
+// the header is followed by the arrays perm, iperm, rows, ptr, snParent,
+// snStart, relindCols, relindCliquePtr, relindClique, cliqueRunsPtr,
+// cliqueRuns, layer0, layer0Start.
+// Each array is stored as its number of entries (int64_t) followed by the
+// entries, padded to a multiple of 8 bytes.
+struct SymbolicHeader {
+  char magic[8];  // "FACTSYM"
+  int version;
+  int type;
+  int packed;
+  int block_size;
+  int n;
+  int sn;
+  int artificial_nz;
+  int largest_front;
+  int largest_sn;
+  int threads;
+  int ordering;
+  uint64_t hash;
+  double nz;
+  double fillin;
+  double max_storage;
+  double operations;
+  double assembly_op;
+  double artificial_op;
 };
 
+const int k_symbolic_version = 3;
+
 // Explanation of relative indices:
 // Each supernode i corresponds to a frontal matrix Fi.
 // The indices of the rows of Fi are called Ri.
@@ -184,20 +272,19 @@ class Symbolic {
 // position of these indices wrt the indices in Ri {2,3,4,7,15}, i.e.,
 // {0,1,2,3,4,1,4,2}.
 //
-// relindClique[i] contains the relative position of the indices of the clique
-// of supernode i {7,15} with respect to Rp {7,8,9,14,15,17,19}, i.e.,
-// relindClique[i] = {0,4}.
-
-// Explanation of consecutive sums:
-// if relindClique[i] = {2,5,8,9,10,11,12,14}, there are (up to) 8 entries that
-// need to be summed for each column of the clique.
-// However, 5 of these indices are consecutive {8,9,10,11,12}. Summing these
-// consecutive entries can be done using daxpy with increment equal to one,
-// which is more efficient that summing one by one.
-// consecutiveSums[i] would contain {1,1,5,4,3,2,1,1}, which means that, if we
-// start from a given row, we can find out how many consecutive copies can be
-// done.
-// E.g., starting from row 4, consecutiveSums[i][4] = 3, which means that the
-// next 3 indices need not be summed by hand, but they can be done using daxpy.
+// relindClique, for supernode i, contains the relative position of the indices
+// of the clique of supernode i {7,15} with respect to Rp {7,8,9,14,15,17,19},
+// i.e., {0,4}.
+
+// Explanation of clique runs:
+// if relindClique, for supernode i, is {2,5,8,9,10,11,12,14}, there are (up to)
+// 8 entries that need to be summed for each column of the clique.
+// However, 5 of these indices are consecutive {8,9,10,11,12}, and the
+// corresponding entries of a column can be summed with a single loop over
+// contiguous entries, which is more efficient than summing them one by one.
+// cliqueRuns, for supernode i, would contain the runs {source,dest,length}
+//  {0,2,1}, {1,5,1}, {2,8,5}, {7,14,1}.
+// When summing column j of the clique, only rows j,...,nc-1 are needed, so the
+// first run used is the one that contains row j, starting from row j.
 
 #endif
\ No newline at end of file
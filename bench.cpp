@@ -0,0 +1,586 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Analyse.h"
+#include "Factorise.h"
+#include "MatrixIO.h"
+
+// Benchmark driver, that reads the matrices from file rather than building
+// them with HiGHS.
+// Matrix Market files (.mtx) and binary CSC files (.csc) are accepted; binary
+// files can be produced by ./fact with the optional dump argument.
+//
+// Each matrix is analysed, factorised and solved with every combination of
+// FactType, OrderType, PackType, AssemblyType and PrecType requested. Each
+// combination is run a number of times to warm up, and then a number of times
+// to measure. The median of the measured runs of each timer is reported, so
+// that results can be diffed against a baseline.
+// With -s, the symbolic factorisation of each matrix, type, ordering and format
+// is saved in a directory the first time, and loaded afterwards instead of
+// running analyse; analyse_total is then the time to load it.
+// With -T, the last run of each combination records a trace of the phases of
+// the factorisation of each supernode, that is written in a directory in the
+// Chrome trace format.
+
+const char* k_usage =
+    "Usage: ./bench [options] matrix.(mtx|csc) ...\n"
+    "  -w N     warmup runs, not measured (default 1)\n"
+    "  -r N     measured runs (default 3)\n"
+    "  -t LIST  types to factorise, comma separated: 0 NormEq, 1 AugSys\n"
+    "           (default: type stored in the file, or 0)\n"
+    "  -o LIST  orderings, comma separated: metis,amd,auto (default metis)\n"
+    "  -p LIST  formats, comma separated: full,hybrid,hybrid2 (default all)\n"
+    "  -a LIST  assembly, comma separated: twopass,singlepass (default "
+    "twopass)\n"
+    "  -f LIST  precision, comma separated: double,single (default double)\n"
+    "  -s DIR   save and reuse the symbolic factorisations in DIR\n"
+    "  -i LEVEL instrumentation: off,phase,kernel,counters (default phase)\n"
+    "  -T DIR   write a trace of the factorisation of each combination in DIR\n"
+    "  -m MB    out-of-core factorisation, with at most MB megabytes of the\n"
+    "           factor waiting to be written to a temporary file\n"
+    "  -l FILE  file with a list of matrices, one per line\n"
+    "  -c FILE  write results in CSV format\n"
+    "  -j FILE  write results in JSON format\n";
+
+// Measured quantities, in the order in which they are reported
+enum bench_field {
+  b_analyse_metis,
+  b_analyse_tree,
+  b_analyse_count,
+  b_analyse_sn,
+  b_analyse_reorder,
+  b_analyse_pattern,
+  b_analyse_relind,
+  b_analyse_layer0,
+  b_analyse_total,
+  b_factorise_prepare,
+  b_factorise_assemble_original,
+  b_factorise_assemble_children_F,
+  b_factorise_assemble_children_C,
+  b_factorise_factorise,
+  b_factorise_total,
+  b_dense_trsm,
+  b_dense_syrk,
+  b_dense_gemm,
+  b_dense_fact,
+  b_dense_copy,
+  b_dense_copy_schur,
+  b_dense_scal,
+  b_dense_convert,
+  b_factorise_cycles,
+  b_factorise_instructions,
+  b_factorise_llc_misses,
+  b_factorise_dtlb_misses,
+  b_memory_peak,
+  b_memory_predicted,
+  b_solve,
+  b_gflops,
+  b_residual,
+  b_refine_iter,
+  b_size
+};
+
+const char* k_field_names[b_size] = {"analyse_metis",
+                                     "analyse_tree",
+                                     "analyse_count",
+                                     "analyse_sn",
+                                     "analyse_reorder",
+                                     "analyse_pattern",
+                                     "analyse_relind",
+                                     "analyse_layer0",
+                                     "analyse_total",
+                                     "factorise_prepare",
+                                     "factorise_assemble_original",
+                                     "factorise_assemble_children_F",
+                                     "factorise_assemble_children_C",
+                                     "factorise_factorise",
+                                     "factorise_total",
+                                     "dense_trsm",
+                                     "dense_syrk",
+                                     "dense_gemm",
+                                     "dense_fact",
+                                     "dense_copy",
+                                     "dense_copy_schur",
+                                     "dense_scal",
+                                     "dense_convert",
+                                     "factorise_cycles",
+                                     "factorise_instructions",
+                                     "factorise_llc_misses",
+                                     "factorise_dtlb_misses",
+                                     "memory_peak",
+                                     "memory_predicted",
+                                     "solve",
+                                     "gflops",
+                                     "residual",
+                                     "refine_iter"};
+
+const char* k_type_names[] = {"NormEq", "AugSys"};
+const char* k_order_names[] = {"Metis", "AMD", "Auto"};
+const char* k_pack_names[] = {"Full", "Hybrid", "Hybrid2"};
+const char* k_assembly_names[] = {"TwoPass", "SinglePass"};
+const char* k_precision_names[] = {"Double", "Single"};
+
+// Result of all the runs of one matrix, with one type, ordering, format,
+// assembly and precision
+struct BenchResult {
+  std::string matrix;
+  FactType type;
+  OrderType ordering;
+  PackType packed;
+  AssemblyType assembly;
+  PrecType precision;
+  int status{};
+  int n{};
+  int nzA{};
+  int nzL{};
+  double ops{};
+  int runs{};
+  double values[b_size]{};
+};
+
+// y = A * x, with A symmetric and only the lower triangle stored
+static void SymMatVec(int n, const std::vector<int>& ptr,
+                      const std::vector<int>& rows,
+                      const std::vector<double>& val,
+                      const std::vector<double>& x, std::vector<double>& y) {
+  y.assign(n, 0.0);
+  for (int col = 0; col < n; ++col) {
+    for (int el = ptr[col]; el < ptr[col + 1]; ++el) {
+      const int row = rows[el];
+      y[row] += val[el] * x[col];
+      if (row != col) y[col] += val[el] * x[row];
+    }
+  }
+}
+
+static double Median(std::vector<double> v) {
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  const int m = v.size() / 2;
+  return v.size() % 2 ? v[m] : 0.5 * (v[m - 1] + v[m]);
+}
+
+static std::vector<std::string> Split(const std::string& s) {
+  std::vector<std::string> tokens;
+  std::stringstream ss(s);
+  std::string token;
+  while (std::getline(ss, token, ',')) {
+    if (!token.empty()) tokens.push_back(token);
+  }
+  return tokens;
+}
+
+// Run analyse, factorise and solve once, and store the measured quantities
+// into values.
+// If symbolic_file is not empty, the symbolic factorisation is loaded from it
+// if possible, otherwise analyse is run and the result is saved into it.
+// If trace_file is not empty, the trace of the factorisation is written to it.
+// If factor_memory_limit is positive, the factorisation is out-of-core.
+static int RunOnce(const std::vector<int>& ptr, const std::vector<int>& rows,
+                   const std::vector<double>& val, FactType type,
+                   OrderType ordering, PackType packed, AssemblyType assembly,
+                   PrecType precision, const std::string& symbolic_file,
+                   const std::string& trace_file, instr_level instrumentation,
+                   double factor_memory_limit, BenchResult& res,
+                   double* values) {
+  const int n = ptr.size() - 1;
+
+  Symbolic S;
+  Clock clock_load;
+  clock_load.start();
+  const uint64_t hash = PatternHash(rows, ptr, type);
+  if (!symbolic_file.empty() &&
+      S.Load(symbolic_file, hash, ordering, packed) == ret_ok) {
+    values[b_analyse_total] = clock_load.stop();
+  } else {
+    Analyse An(rows, ptr, type);
+    An.packed = packed;
+    An.ordering = ordering;
+    const int status = An.Run(S);
+    if (status) return status;
+    if (!symbolic_file.empty()) S.Save(symbolic_file, hash);
+
+    values[b_analyse_metis] = An.time_metis;
+    values[b_analyse_tree] = An.time_tree;
+    values[b_analyse_count] = An.time_count;
+    values[b_analyse_sn] = An.time_sn;
+    values[b_analyse_reorder] = An.time_reorder;
+    values[b_analyse_pattern] = An.time_pattern;
+    values[b_analyse_relind] = An.time_relind;
+    values[b_analyse_layer0] = An.time_layer0;
+    values[b_analyse_total] = An.time_total;
+  }
+
+  Numeric Num;
+  Factorise F(S, rows, ptr, val);
+  F.assembly = assembly;
+  F.precision = precision;
+  F.instrumentation = instrumentation;
+  F.trace = !trace_file.empty();
+  F.factor_memory_limit = factor_memory_limit;
+  const int status = F.Run(Num);
+  if (status) return status;
+  if (F.trace) F.WriteTrace(trace_file);
+
+  std::vector<double> rhs(n);
+  for (int i = 0; i < n; ++i) rhs[i] = i;
+  std::vector<double> sol(rhs);
+
+  Clock clock;
+  clock.start();
+  Num.Solve(sol);
+  values[b_solve] = clock.stop();
+
+  std::vector<double> res_vec;
+  SymMatVec(n, ptr, rows, val, sol, res_vec);
+  double res_norm{};
+  double rhs_norm{};
+  for (int i = 0; i < n; ++i) {
+    res_norm += (res_vec[i] - rhs[i]) * (res_vec[i] - rhs[i]);
+    rhs_norm += rhs[i] * rhs[i];
+  }
+  values[b_residual] = sqrt(res_norm) / std::max(sqrt(rhs_norm), 1.0);
+  values[b_refine_iter] = Num.refine_iter;
+
+  values[b_factorise_prepare] = F.time_prepare;
+  values[b_factorise_assemble_original] = F.time_assemble_original;
+  values[b_factorise_assemble_children_F] = F.time_assemble_children_F;
+  values[b_factorise_assemble_children_C] = F.time_assemble_children_C;
+  values[b_factorise_factorise] = F.time_factorise;
+  values[b_factorise_total] = F.time_total;
+
+  values[b_dense_trsm] = F.times_dense_fact[t_dtrsm];
+  values[b_dense_syrk] = F.times_dense_fact[t_dsyrk];
+  values[b_dense_gemm] = F.times_dense_fact[t_dgemm];
+  values[b_dense_fact] = F.times_dense_fact[t_fact];
+  values[b_dense_copy] = F.times_dense_fact[t_dcopy];
+  values[b_dense_copy_schur] = F.times_dense_fact[t_dcopy_schur];
+  values[b_dense_scal] = F.times_dense_fact[t_dscal];
+  values[b_dense_convert] = F.times_dense_fact[t_convert];
+
+  // hardware counters of the whole factorisation, summed over the phases
+  for (int i = 0; i < tr_size; ++i) {
+    const double* counters = &F.counters_phase[i * hc_size];
+    values[b_factorise_cycles] += counters[hc_cycles];
+    values[b_factorise_instructions] += counters[hc_instructions];
+    values[b_factorise_llc_misses] += counters[hc_llc_misses];
+    values[b_factorise_dtlb_misses] += counters[hc_dtlb_misses];
+  }
+
+  values[b_memory_peak] = F.memory_peak_total;
+  values[b_memory_predicted] = S.MaxStorage();
+
+  values[b_gflops] = F.time_total > 0 ? S.Ops() / F.time_total * 1e-9 : 0.0;
+
+  res.n = n;
+  res.nzA = ptr.back();
+  res.nzL = S.Nz();
+  res.ops = S.Ops();
+
+  return ret_ok;
+}
+
+static void WriteCSV(const std::string& file_name,
+                     const std::vector<BenchResult>& results) {
+  FILE* file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    printf("Cannot open %s\n", file_name.c_str());
+    return;
+  }
+  fprintf(file,
+          "matrix,type,order,pack,assembly,precision,status,n,nzA,nzL,ops,"
+          "runs");
+  for (int i = 0; i < b_size; ++i) fprintf(file, ",%s", k_field_names[i]);
+  fprintf(file, "\n");
+  for (const BenchResult& r : results) {
+    fprintf(file, "%s,%s,%s,%s,%s,%s,%d,%d,%d,%d,%.6e,%d", r.matrix.c_str(),
+            k_type_names[(int)r.type], k_order_names[(int)r.ordering],
+            k_pack_names[(int)r.packed],
+            k_assembly_names[(int)r.assembly],
+            k_precision_names[(int)r.precision], r.status, r.n, r.nzA, r.nzL,
+            r.ops, r.runs);
+    for (int i = 0; i < b_size; ++i) fprintf(file, ",%.6e", r.values[i]);
+    fprintf(file, "\n");
+  }
+  fclose(file);
+}
+
+static void WriteJSON(const std::string& file_name,
+                      const std::vector<BenchResult>& results) {
+  FILE* file = fopen(file_name.c_str(), "w");
+  if (!file) {
+    printf("Cannot open %s\n", file_name.c_str());
+    return;
+  }
+  fprintf(file, "[\n");
+  for (int k = 0; k < results.size(); ++k) {
+    const BenchResult& r = results[k];
+    fprintf(file,
+            "  {\"matrix\": \"%s\", \"type\": \"%s\", \"order\": \"%s\", "
+            "\"pack\": \"%s\", "
+            "\"assembly\": \"%s\", \"precision\": \"%s\", \"status\": %d, "
+            "\"n\": %d, \"nzA\": %d, \"nzL\": %d, \"ops\": %.6e, \"runs\": %d",
+            r.matrix.c_str(), k_type_names[(int)r.type],
+            k_order_names[(int)r.ordering], k_pack_names[(int)r.packed],
+            k_assembly_names[(int)r.assembly],
+            k_precision_names[(int)r.precision], r.status, r.n, r.nzA, r.nzL,
+            r.ops, r.runs);
+    for (int i = 0; i < b_size; ++i)
+      fprintf(file, ", \"%s\": %.6e", k_field_names[i], r.values[i]);
+    fprintf(file, "}%s\n", k + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "]\n");
+  fclose(file);
+}
+
+int main(int argc, char** argv) {
+  int warmup = 1;
+  int repeat = 3;
+  std::vector<int> types;
+  std::vector<OrderType> orderings;
+  std::vector<PackType> packs;
+  std::vector<AssemblyType> assemblies;
+  std::vector<PrecType> precisions;
+  std::vector<std::string> matrices;
+  std::string csv_file;
+  std::string symbolic_dir;
+  std::string trace_dir;
+  instr_level instrumentation = instr_phase;
+  double factor_memory_limit{};
+  std::string json_file;
+
+  // ===========================================================================
+  // Read the options
+  // ===========================================================================
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg[0] != '-') {
+      matrices.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, "%s", k_usage);
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "-w") {
+      warmup = atoi(value.c_str());
+    } else if (arg == "-r") {
+      repeat = std::max(1, atoi(value.c_str()));
+    } else if (arg == "-t") {
+      for (const std::string& t : Split(value)) {
+        const int type_int = atoi(t.c_str());
+        if (type_int < 0 || type_int > (int)FactType::AugSys) {
+          fprintf(stderr, "Unknown type %s\n%s", t.c_str(), k_usage);
+          return 1;
+        }
+        types.push_back(type_int);
+      }
+    } else if (arg == "-o") {
+      for (const std::string& o : Split(value)) {
+        if (o == "metis")
+          orderings.push_back(OrderType::Metis);
+        else if (o == "amd")
+          orderings.push_back(OrderType::Amd);
+        else if (o == "auto")
+          orderings.push_back(OrderType::Auto);
+        else {
+          fprintf(stderr, "Unknown ordering %s\n%s", o.c_str(), k_usage);
+          return 1;
+        }
+      }
+    } else if (arg == "-p") {
+      for (const std::string& p : Split(value)) {
+        if (p == "full")
+          packs.push_back(PackType::Full);
+        else if (p == "hybrid")
+          packs.push_back(PackType::Hybrid);
+        else if (p == "hybrid2")
+          packs.push_back(PackType::Hybrid2);
+        else {
+          fprintf(stderr, "Unknown format %s\n%s", p.c_str(), k_usage);
+          return 1;
+        }
+      }
+    } else if (arg == "-a") {
+      for (const std::string& a : Split(value)) {
+        if (a == "twopass")
+          assemblies.push_back(AssemblyType::TwoPass);
+        else if (a == "singlepass")
+          assemblies.push_back(AssemblyType::SinglePass);
+        else {
+          fprintf(stderr, "Unknown assembly %s\n%s", a.c_str(), k_usage);
+          return 1;
+        }
+      }
+    } else if (arg == "-f") {
+      for (const std::string& f : Split(value)) {
+        if (f == "double")
+          precisions.push_back(PrecType::Double);
+        else if (f == "single")
+          precisions.push_back(PrecType::Single);
+        else {
+          fprintf(stderr, "Unknown precision %s\n%s", f.c_str(), k_usage);
+          return 1;
+        }
+      }
+    } else if (arg == "-s") {
+      symbolic_dir = value;
+    } else if (arg == "-i") {
+      if (value == "off")
+        instrumentation = instr_off;
+      else if (value == "phase")
+        instrumentation = instr_phase;
+      else if (value == "kernel")
+        instrumentation = instr_kernel;
+      else if (value == "counters")
+        instrumentation = instr_counters;
+      else {
+        fprintf(stderr, "Unknown instrumentation %s\n%s", value.c_str(),
+                k_usage);
+        return 1;
+      }
+    } else if (arg == "-T") {
+      trace_dir = value;
+    } else if (arg == "-m") {
+      factor_memory_limit = atof(value.c_str()) * 1e6;
+    } else if (arg == "-l") {
+      std::ifstream list(value);
+      std::string line;
+      while (std::getline(list, line)) {
+        if (!line.empty() && line[0] != '#') matrices.push_back(line);
+      }
+    } else if (arg == "-c") {
+      csv_file = value;
+    } else if (arg == "-j") {
+      json_file = value;
+    } else {
+      fprintf(stderr, "%s", k_usage);
+      return 1;
+    }
+  }
+
+  if (matrices.empty()) {
+    fprintf(stderr, "%s", k_usage);
+    return 1;
+  }
+  if (orderings.empty()) orderings = {OrderType::Metis};
+  if (packs.empty())
+    packs = {PackType::Full, PackType::Hybrid, PackType::Hybrid2};
+  if (assemblies.empty()) assemblies = {AssemblyType::TwoPass};
+  if (precisions.empty()) precisions = {PrecType::Double};
+
+  // ===========================================================================
+  // Run the benchmarks
+  // ===========================================================================
+  std::vector<BenchResult> results;
+
+  for (const std::string& matrix : matrices) {
+    int n{};
+    int file_type = (int)FactType::NormEq;
+    std::vector<int> ptrLower;
+    std::vector<int> rowsLower;
+    std::vector<double> valLower;
+    if (ReadMatrix(matrix, n, file_type, ptrLower, rowsLower, valLower)) {
+      printf("Skipping %s\n", matrix.c_str());
+      continue;
+    }
+
+    std::vector<int> matrix_types(types);
+    if (matrix_types.empty()) matrix_types.push_back(file_type);
+
+    for (int type_int : matrix_types) {
+      for (OrderType ordering : orderings) {
+        for (PackType packed : packs) {
+          for (AssemblyType assembly : assemblies) {
+            for (PrecType precision : precisions) {
+              const size_t slash = matrix.find_last_of('/');
+              std::string symbolic_file;
+              if (!symbolic_dir.empty()) {
+                symbolic_file = symbolic_dir + "/" +
+                                matrix.substr(slash + 1) + "." +
+                                k_type_names[type_int] + "." +
+                                k_order_names[(int)ordering] + "." +
+                                k_pack_names[(int)packed] + ".sym";
+              }
+              std::string trace_file;
+              if (!trace_dir.empty()) {
+                trace_file = trace_dir + "/" + matrix.substr(slash + 1) +
+                             "." + k_type_names[type_int] + "." +
+                             k_order_names[(int)ordering] + "." +
+                             k_pack_names[(int)packed] + "." +
+                             k_assembly_names[(int)assembly] + "." +
+                             k_precision_names[(int)precision] + ".json";
+              }
+
+              BenchResult res;
+              res.matrix = matrix;
+              res.type = (FactType)type_int;
+              res.ordering = ordering;
+              res.packed = packed;
+              res.assembly = assembly;
+              res.precision = precision;
+
+              std::vector<std::vector<double>> runs(b_size);
+              for (int run = 0; run < warmup + repeat; ++run) {
+                double values[b_size]{};
+                const bool last = run == warmup + repeat - 1;
+                res.status = RunOnce(ptrLower, rowsLower, valLower, res.type,
+                                     ordering, packed, assembly, precision,
+                                     symbolic_file,
+                                     last ? trace_file : std::string(),
+                                     instrumentation, factor_memory_limit,
+                                     res, values);
+                if (res.status) break;
+                if (run < warmup) continue;
+                for (int i = 0; i < b_size; ++i)
+                  runs[i].push_back(values[i]);
+              }
+
+              res.runs = runs[0].size();
+              for (int i = 0; i < b_size; ++i)
+                res.values[i] = Median(runs[i]);
+              results.push_back(res);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // ===========================================================================
+  // Report
+  // ===========================================================================
+  printf("\n%-30s %-7s %-6s %-8s %-10s %-6s %10s %10s %10s %8s %10s\n",
+         "matrix", "type", "order", "pack", "assembly", "prec", "analyse",
+         "factorise", "solve", "GFLOP/s", "residual");
+  for (const BenchResult& r : results) {
+    if (r.status) {
+      printf("%-30s %-7s %-6s %-8s %-10s %-6s failed with status %d\n",
+             r.matrix.c_str(), k_type_names[(int)r.type],
+             k_order_names[(int)r.ordering], k_pack_names[(int)r.packed],
+             k_assembly_names[(int)r.assembly],
+             k_precision_names[(int)r.precision], r.status);
+      continue;
+    }
+    printf(
+        "%-30s %-7s %-6s %-8s %-10s %-6s %10.4f %10.4f %10.4f %8.2f "
+        "%10.2e\n",
+        r.matrix.c_str(), k_type_names[(int)r.type],
+        k_order_names[(int)r.ordering], k_pack_names[(int)r.packed],
+        k_assembly_names[(int)r.assembly], k_precision_names[(int)r.precision],
+        r.values[b_analyse_total], r.values[b_factorise_total],
+        r.values[b_solve], r.values[b_gflops], r.values[b_residual]);
+  }
+
+  if (!csv_file.empty()) WriteCSV(csv_file, results);
+  if (!json_file.empty()) WriteJSON(json_file, results);
+
+  return 0;
+}
@@ -6,10 +6,17 @@
 
 #include "Analyse.h"
 #include "Factorise.h"
+#include "MatrixIO.h"
+#include "NormalEquations.h"
 #include "Highs.h"
 #include "hsl_wrapper.h"
 #include "io/Filereader.h"
 
+// Columns of A with more than k_dense_col_factor * sqrt(m) nonzeros are dense;
+// at most k_max_dense_cols of them are handled separately
+const double k_dense_col_factor = 10.0;
+const int k_max_dense_cols = 100;
+
 struct MA86Data {
   void* keep;
   ma86_control_d control;
@@ -47,106 +54,29 @@ struct MC68Data {
   std::vector<int> order;
 };
 
-int computeAThetaAT(const HighsSparseMatrix& matrix,
-                    const std::vector<double>& theta, HighsSparseMatrix& AAT) {
-  // Create a row-wise copy of the matrix
-  HighsSparseMatrix AT = matrix;
-  AT.ensureRowwise();
-
-  int AAT_dim = matrix.num_row_;
-  AAT.num_col_ = AAT_dim;
-  AAT.num_row_ = AAT_dim;
-  AAT.start_.resize(AAT_dim + 1, 0);
-
-  std::vector<std::tuple<int, int, double>> non_zero_values;
-
-  // First pass to calculate the number of non-zero elements in each column
-  //
-  int AAT_num_nz = 0;
-  std::vector<double> AAT_col_value(AAT_dim, 0);
-  std::vector<int> AAT_col_index(AAT_dim);
-  std::vector<bool> AAT_col_in_index(AAT_dim, false);
-  for (int iRow = 0; iRow < AAT_dim; iRow++) {
-    // Go along the row of A, and then down the columns corresponding
-    // to its nonzeros
-    int num_col_el = 0;
-    for (int iRowEl = AT.start_[iRow]; iRowEl < AT.start_[iRow + 1]; iRowEl++) {
-      int iCol = AT.index_[iRowEl];
-      const double theta_value = !theta.empty() ? theta[iCol] : 1;
-      if (!theta_value) continue;
-      const double row_value = theta_value * AT.value_[iRowEl];
-      for (int iColEl = matrix.start_[iCol]; iColEl < matrix.start_[iCol + 1];
-           iColEl++) {
-        int iRow1 = matrix.index_[iColEl];
-        if (iRow1 < iRow) continue;
-        double term = row_value * matrix.value_[iColEl];
-        if (!AAT_col_in_index[iRow1]) {
-          // This entry is not yet in the list of possible nonzeros
-          AAT_col_in_index[iRow1] = true;
-          AAT_col_index[num_col_el++] = iRow1;
-          AAT_col_value[iRow1] = term;
-        } else {
-          // This entry is in the list of possible nonzeros
-          AAT_col_value[iRow1] += term;
-        }
-      }
-    }
-    for (int iEl = 0; iEl < num_col_el; iEl++) {
-      int iCol = AAT_col_index[iEl];
-      assert(iCol >= iRow);
-      const double value = AAT_col_value[iCol];
-      if (std::abs(value) > 1e-10) {
-        non_zero_values.emplace_back(iRow, iCol, value);
-        const int num_new_nz = iRow != iCol ? 2 : 1;
-        AAT.start_[iRow + 1]++;
-        if (iRow != iCol) AAT.start_[iCol + 1]++;
-        AAT_num_nz += num_new_nz;
-      }
-      AAT_col_value[iCol] =
-          0;  // Not strictly necessary, but simplifies debugging
-      AAT_col_in_index[iCol] = false;
-    }
-  }
-
-  // Prefix sum to get the correct column pointers
-  for (int i = 0; i < AAT_dim; ++i) AAT.start_[i + 1] += AAT.start_[i];
+std::vector<int> findDenseColumns(const HighsSparseMatrix& matrix) {
+  // Find the dense columns of the matrix, in decreasing order of nonzeros.
+  // If there are too many, only the densest are returned.
 
-  AAT.index_.resize(AAT.start_.back());
-  AAT.value_.resize(AAT.start_.back());
-  AAT.p_end_ = AAT.start_;
-  AAT.p_end_.back() = AAT.index_.size();
-
-  std::vector<int> current_positions = AAT.start_;
-
-  // Second pass to actually fill in the indices and values
-  for (const auto& val : non_zero_values) {
-    int i = std::get<0>(val);
-    int j = std::get<1>(val);
-    double dot = std::get<2>(val);
-
-    // add dual regularization
-    if (i == j) dot += 100;
-
-    AAT.index_[current_positions[i]] = j;
-    AAT.value_[current_positions[i]] = dot;
-    current_positions[i]++;
-    AAT.p_end_[i] = current_positions[i];
-
-    if (i != j) {
-      AAT.index_[current_positions[j]] = i;
-      AAT.value_[current_positions[j]] = dot;
-      current_positions[j]++;
-      AAT.p_end_[j] = current_positions[j];
-    }
+  const double threshold = k_dense_col_factor * sqrt(matrix.num_row_);
+  std::vector<std::pair<int, int>> dense;
+  for (int col = 0; col < matrix.num_col_; ++col) {
+    const int col_nz = matrix.start_[col + 1] - matrix.start_[col];
+    if (col_nz > threshold) dense.emplace_back(-col_nz, col);
   }
-  AAT.p_end_.clear();
-  return 0;
+  std::sort(dense.begin(), dense.end());
+  if (dense.size() > k_max_dense_cols) dense.resize(k_max_dense_cols);
+
+  std::vector<int> dense_cols;
+  for (const auto& d : dense) dense_cols.push_back(d.second);
+  return dense_cols;
 }
 
 int main(int argc, char** argv) {
   if (argc < 6) {
-    std::cerr << "Wrong input: ./fact pb augSys(0-1) HSL(0-1) Metis(0-1) "
-                 "print(0-1)\n";
+    std::cerr << "Wrong input: ./fact pb augSys(0-1) HSL(0-1) "
+                 "order(0 MC68, 1 Metis, 2 AMD, 3 auto) print(0-1) "
+                 "[dump.csc|-] [symbolic.sym]\n";
     return 1;
   }
 
@@ -179,6 +109,11 @@ int main(int argc, char** argv) {
   int n;
   int nz;
 
+  // dense columns of A, stored by columns, for the low-rank correction of the
+  // normal equations
+  std::vector<double> lowrank_U;
+  int lowrank_k = 0;
+
   if (type == FactType::AugSys) {
     // Augmented system, lower triangular
 
@@ -214,25 +149,40 @@ int main(int argc, char** argv) {
     n = nA + mA;
     nz = nA + nzA + mA;
   } else {
-    // Normal equations, full matrix
-    std::vector<double> theta;
-    HighsSparseMatrix AAt;
-    int status = computeAThetaAT(lp.a_matrix_, theta, AAt);
-
-    // extract lower triangle
-    n = mA;
-    for (int col = 0; col < n; ++col) {
-      ptrLower.push_back(valLower.size());
-      for (int el = AAt.start_[col]; el < AAt.start_[col + 1]; el++) {
-        int row = AAt.index_[el];
-        if (row >= col) {
-          valLower.push_back(AAt.value_[el]);
-          rowsLower.push_back(row);
-        }
+    // Normal equations, full matrix.
+    // The dense columns of A would make A * A^T almost full. They are left out
+    // of the matrix that is factorised and are added back in the solve, as a
+    // low-rank correction. This is not done when
+    // comparing with HSL, which would factorise a different matrix.
+    std::vector<int> dense_cols;
+    if (atoi(argv[3]) == 0) dense_cols = findDenseColumns(lp.a_matrix_);
+    if (!dense_cols.empty()) {
+      const HighsSparseMatrix& A = lp.a_matrix_;
+      lowrank_k = dense_cols.size();
+      lowrank_U.assign((size_t)mA * lowrank_k, 0.0);
+      for (int k = 0; k < lowrank_k; ++k) {
+        const int col = dense_cols[k];
+        for (int el = A.start_[col]; el < A.start_[col + 1]; ++el)
+          lowrank_U[A.index_[el] + (size_t)mA * k] = A.value_[el];
       }
+      printf("Dense columns: %d\n", lowrank_k);
     }
-    ptrLower.push_back(valLower.size());
 
+    // The pattern is computed once; in an interior point method, only Fill
+    // would be called at each iteration, with the new theta.
+    // Theta is the identity here, and 100 is the dual regularization.
+    NormalEquations NE;
+    if (NE.Setup(mA, lp.a_matrix_.start_, lp.a_matrix_.index_,
+                 lp.a_matrix_.value_, dense_cols))
+      return 1;
+    Clock clock_normeq;
+    clock_normeq.start();
+    if (NE.Fill({}, 100.0, valLower)) return 1;
+    printf("Normal equations time %f\n", clock_normeq.stop());
+
+    n = mA;
+    ptrLower = NE.Ptr();
+    rowsLower = NE.Rows();
     nz = ptrLower.back();
   }
 
@@ -250,6 +200,13 @@ int main(int argc, char** argv) {
       1,  1, 20, 20, 20, 1,  1, 1, 1,  20, 20, 1,  1, 1, 1, 20, 20, 1,  20,
   20};*/
 
+  // save the matrix, so that it can be used by bench without HiGHS
+  if (argc > 6 && std::string(argv[6]) != "-") {
+    if (WriteBinaryCSC(argv[6], n, (int)type, ptrLower, rowsLower, valLower))
+      return 1;
+    printf("Matrix saved to %s\n", argv[6]);
+  }
+
   // ===========================================================================
   // AMD ordering with MC68
   // ===========================================================================
@@ -272,21 +229,44 @@ int main(int argc, char** argv) {
   // ===========================================================================
   // Symbolic factorisation
   // ===========================================================================
+  // If a symbolic file is given and it was saved for the same pattern, ordering
+  // and format, the analyse phase is skipped, and the times of An are zero.
+  // Otherwise, the result of analyse is saved into it. The file is not used
+  // with an ordering given to analyse, which cannot be checked.
   Symbolic S;
   Analyse An(rowsLower, ptrLower, type, order_to_use);
-  An.Run(S);
-  S.Print();
+  if (atoi(argv[4]) > 0) An.ordering = (OrderType)(atoi(argv[4]) - 1);
+  const bool use_symbolic_file = argc > 7 && atoi(argv[4]) > 0;
+  const uint64_t pattern_hash = PatternHash(rowsLower, ptrLower, type);
+  if (use_symbolic_file &&
+      S.Load(argv[7], pattern_hash, An.ordering, An.packed) == 0) {
+    printf("Symbolic factorisation loaded from %s\n", argv[7]);
+    S.Print();
+    order_to_use = S.Iperm();
+  } else {
+    if (An.Run(S)) return 1;
+    S.Print();
+    if (use_symbolic_file && S.Save(argv[7], pattern_hash) == 0)
+      printf("Symbolic factorisation saved to %s\n", argv[7]);
 
-  // save inverse permutation to pass to MAxx
-  if (atoi(argv[4]) == 1) order_to_use = An.metis_order;
+    // save inverse permutation to pass to MAxx
+    if (atoi(argv[4]) > 0) order_to_use = An.metis_order;
+  }
 
   // ===========================================================================
   // Numerical factorisation
   // ===========================================================================
   Numeric Num;
   Factorise F(S, rowsLower, ptrLower, valLower);
+  if (type == FactType::AugSys) {
+    // quasidefinite matrix: positive pivots in the 1,1 block, negative in the
+    // 2,2 block
+    F.pivot_sign.assign(n, 1);
+    std::fill(F.pivot_sign.begin() + nA, F.pivot_sign.end(), -1);
+  }
   int ret_status = F.Run(Num);
   if (ret_status) return 1;
+  if (lowrank_k > 0 && Num.SetLowRank(lowrank_U, lowrank_k)) return 1;
 
   // ===========================================================================
   // Solve
@@ -582,12 +562,16 @@ int main(int argc, char** argv) {
     // print results
     FILE* file = fopen("results.txt", "a");
 
+    // the times of analyse are zero if the symbolic factorisation was loaded
+    auto percent_analyse = [&An](double t) {
+      return An.time_total > 0 ? t / An.time_total * 100 : 0.0;
+    };
     fprintf(
         file, "%15s  |  %12.1e %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f  |  ",
-        pb_name.c_str(), An.time_total, An.time_metis / An.time_total * 100,
-        An.time_tree / An.time_total * 100, An.time_count / An.time_total * 100,
-        An.time_sn / An.time_total * 100, An.time_pattern / An.time_total * 100,
-        An.time_relind / An.time_total * 100);
+        pb_name.c_str(), An.time_total, percent_analyse(An.time_metis),
+        percent_analyse(An.time_tree), percent_analyse(An.time_count),
+        percent_analyse(An.time_sn), percent_analyse(An.time_pattern),
+        percent_analyse(An.time_relind));
 
     fprintf(file, "%12.1e %10.1f %10.1f %10.1f %10.1f %10.1f  |  ",
             F.time_total, F.time_prepare / F.time_total * 100,